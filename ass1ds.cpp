@@ -1,11 +1,18 @@
 #include "ass1ds.hpp"
 
 extern "C" {
-	char*                         kalloc();
 	void                          panic(char*) __attribute__((noreturn));
-	void*                         memset(void*, int, uint);
 	void                          initSchedDS();
 	long long                     getAccumulator(Proc *p);
+	int                           getWeight(Proc *p);
+	int                           cpuid();
+	void                          pushcli();
+	void                          popcli();
+	void                          acquire(struct spinlock*);
+	void                          release(struct spinlock*);
+	void                          initlock(struct spinlock*, char*);
+	void                          lockdump(struct spinlock*);
+	void                          cprintf(char*, ...);
 	long long                     __moddi3(long long number, long long divisor);
 
 	//for pq
@@ -13,6 +20,8 @@ extern "C" {
 	static boolean                putPriorityQueue(Proc* p);
 	static boolean                getMinAccumulatorPriorityQueue(long long* pkey);
 	static Proc*                  extractMinPriorityQueue();
+	static Proc*                  extractGlobalMinPriorityQueue();
+	static Proc*                  extractLeastRecentPriorityQueue();
 	static boolean                switchToRoundRobinPolicyPriorityQueue();
 	static boolean                extractProcPriorityQueue(Proc *p);
 
@@ -22,88 +31,479 @@ extern "C" {
 	static Proc*                  dequeueRoundRobinQueue();
 	static boolean                switchToPriorityQueuePolicyRoundRobinQueue();
 
+	//for mlfq
+	static boolean                isEmptyMultiLevelQueue();
+	static boolean                enqueueMultiLevelQueue(Proc *p);
+	static Proc*                  dequeueMultiLevelQueue();
+	static boolean                boostMultiLevelQueue();
+	static boolean                switchToRoundRobinPolicyMultiLevelQueue();
+	static boolean                switchFromRoundRobinPolicyMultiLevelQueue();
+
+	//for rtq
+	static boolean                isEmptyRealTimeQueue();
+	static boolean                putRealTimeQueue(Proc *p);
+	static Proc*                  extractMinRealTimeQueue();
+	static boolean                extractProcRealTimeQueue(Proc *p);
+
 	//for rpholder
 	static boolean                isEmptyRunningProcessHolder();
 	static boolean                addRunningProcessHolder(Proc* p);
 	static boolean                removeRunningProcessHolder(Proc* p);
 	static boolean                getMinAccumulatorRunningProcessHolder(long long *pkey);
+	static void                   rekeyRunningProcessHolder();
 
 	extern PriorityQueue          pq;
 	extern RoundRobinQueue        rrq;
+	extern MultiLevelFeedbackQueue mlfq;
+	extern RealTimeQueue          rtq;
 	extern RunningProcessesHolder rpholder;
 
 	PriorityQueue                 pq;
 	RoundRobinQueue               rrq;
+	MultiLevelFeedbackQueue       mlfq;
+	RealTimeQueue                 rtq;
 	RunningProcessesHolder        rpholder;
 }
 
-#define PGSIZE                    4096
-#define NPROCLIST                 (2*NPROC) //take some extra space
-#define NPROCMAP                  (2*NPROC) //take some extra space
+#define AFFINE_SLACK              2 //how many more procs than the local queue the last cpu's may hold and still be preferred
+#define BUILD_DEPTH               32 //the frames RBTree::build needs for any int number of procs: 31 levels, and the empty subtrees below
+
+static RunQueue                   *runQueues[NCPU];   //one per cpu, indexed by cpuid()
+static ProcHeap<NCPU>             *runningProcHolder; //at most one running proc per cpu
+static DeadlineMap                *deadlineQ;         //the real-time procs of all the cpus
+static struct spinlock            deadlineLock;       //guards deadlineQ
+static int                        deadlineQueued[NCPU]; //per cpu, the procs of deadlineQ that may run on it. Guarded by deadlineLock
+static long long                  globalMinKey;       //the min key of the priority queues of all the cpus...
+static bool                       globalMinValid;     //...unless this is false, and if...
+static bool                       globalMinNone;      //...this is false. Otherwise they are all empty
+static struct spinlock            globalMinLock;      //guards the three above. Taken inside the run queue locks
+
+//Nothing is allocated per operation, since the procs are linked through their own hooks, and the
+//structures above are known at build time. So they live in .bss, each on cache lines of its own,
+//and initSchedDS() assigns them, since the kernel runs no global constructors.
+static char                       runQueueStore[NCPU][sizeof(RunQueue)] __attribute__((aligned(CACHELINE)));
+static char                       runningProcHolderStore[sizeof(ProcHeap<NCPU>)] __attribute__((aligned(CACHELINE)));
+static char                       deadlineQStore[sizeof(DeadlineMap)] __attribute__((aligned(CACHELINE)));
+
+//Runnable procs are queued on the cpu they last ran on, see runQueueFor(). A cpu whose own
+//queue is empty steals from the peer with the most procs queued, unless that peer's next proc
+//may not run on it.
+//Each RunQueue has its own lock, so the scheduler can pick a proc without ptable.lock.
+//The wrappers below may be called with interrupts enabled, hence the pushcli around cpuid().
+static RunQueue* localRunQueue() {
+	return runQueues[cpuid()];
+}
+
+static inline bool mayRun(Proc *p, int cpu) { //is the cpu in p's affinity mask?
+	return p->affinity & (1u << cpu);
+}
 
-static Map                        *priorityQ;
-static LinkedList                 *roundRobinQ;
-static LinkedList                 *runningProcHolder;
+//A proc is queued on the cpu it last ran on, whose caches still hold its lines, unless that queue
+//is overloaded compared to the local one. Only the cpus in the proc's affinity mask qualify.
+template<typename Queue>
+static RunQueue* runQueueFor(Proc *p, Queue RunQueue::*member) {
+	RunQueue *local = localRunQueue();
+	if(p->last_cpu >= 0 && mayRun(p, p->last_cpu)) {
+		RunQueue *last = runQueues[p->last_cpu];
+		if(!mayRun(p, local->cpu) ||
+		   (last->*member).getSize() <= (local->*member).getSize() + AFFINE_SLACK)
+			return last;
+	}
+	if(mayRun(p, local->cpu))
+		return local;
+
+	RunQueue *least = null; //neither qualifies: the least loaded cpu that does.
+	for(int i = 0; i < ncpu; ++i)
+		if(mayRun(p, i) && (!least || (runQueues[i]->*member).getSize() < (least->*member).getSize()))
+			least = runQueues[i];
+	return least ? least : local; //setaffinity() never leaves a mask without online cpus.
+}
 
-static Link                       *freeLinks;
-static MapNode                    *freeNodes;
+static void countQueued(RunQueue *rq, Proc *p, int delta) { //adds p, or removes it for a negative delta, to rq's load and its per cpu counts. Called with rq->lock held.
+	rq->load += delta * p->rqweight;
+	for(int i = 0; i < ncpu; ++i)
+		if(p->rqaffinity & (1u << i))
+			rq->runnable[i] += delta;
+}
 
-static char                       *data;
-static uint                       spaceLeft;
-                
-static char* mymalloc(uint size) {
-	if(spaceLeft < size) {
-		data = kalloc();
-		memset(data, 0, PGSIZE);
-		spaceLeft = PGSIZE;
+template<typename Queue>
+static bool lockIfStealable(RunQueue *rq, Queue RunQueue::*member, int cpu) { //locks rq iff its next proc may run on the cpu.
+	acquire(&rq->lock);
+	Proc *next = (rq->*member).peek();
+	if(next && mayRun(next, cpu))
+		return true;
+	release(&rq->lock);
+	return false;
+}
+
+template<typename Queue>
+static RunQueue* lockRunQueueToRun(Queue RunQueue::*member) { //locks the local queue, or a peer's one when it is empty. Returns null if there is nothing to run here.
+	RunQueue *local = localRunQueue();
+	acquire(&local->lock);
+	if(!(local->*member).isEmpty())
+		return local;
+	release(&local->lock);
+
+	RunQueue *busiest = null;
+	int most = 0;
+	for(int i = 0; i < ncpu; ++i) { //peer sizes are only hints, they are read without their locks.
+		int size = (runQueues[i]->*member).getSize();
+		if(size > most && runQueues[i]->runnable[local->cpu]) {
+			most = size;
+			busiest = runQueues[i];
+		}
 	}
+	if(!busiest)
+		return null;
+	if(lockIfStealable(busiest, member, local->cpu))
+		return busiest;
+
+	for(int i = 0; i < ncpu; ++i) //the busiest's next proc may not run here, try the others'.
+		if(runQueues[i] != busiest && (runQueues[i]->*member).getSize() && runQueues[i]->runnable[local->cpu] &&
+		   lockIfStealable(runQueues[i], member, local->cpu))
+			return runQueues[i];
+	return null;
+}
 
-	char* ans = data;
-	data += size;
-	spaceLeft -= size;
+//get_min_acc() runs on every fork and wakeup, so the min key of the priority queues is cached
+//rather than found by locking every run queue. A put only lowers it, and an extract only
+//invalidates it when it takes the cached min itself. Both are called with rq->lock held.
+static void globalMinPut(long long key) {
+	acquire(&globalMinLock);
+	if(globalMinValid && (globalMinNone || key < globalMinKey)) {
+		globalMinKey = key;
+		globalMinNone = false;
+	}
+	release(&globalMinLock);
+}
+
+static void globalMinExtract(RunQueue *rq) { //called before a proc is extracted from rq->priorityQ.
+	long long key;
+	if(!rq->priorityQ.getMinKey(&key)) //the proc's key is at least rq's min key.
+		return;
+	acquire(&globalMinLock);
+	if(key <= globalMinKey)
+		globalMinValid = false;
+	release(&globalMinLock);
+}
+
+static void globalMinInvalidate() {
+	acquire(&globalMinLock);
+	globalMinValid = false;
+	release(&globalMinLock);
+}
+
+template<typename Queue>
+static boolean isEmptyRunQueues(Queue RunQueue::*member) { //is nothing queued that may run on this cpu? A lockless hint, like the sizes above.
+	pushcli();
+	int cpu = cpuid();
+	boolean ans = true;
+	for(int i = 0; i < ncpu && ans; ++i)
+		if(runQueues[i]->runnable[cpu] && (runQueues[i]->*member).getSize())
+			ans = false;
+	popcli();
 	return ans;
 }
 
 //for pq
 static boolean isEmptyPriorityQueue() {
-	return priorityQ->isEmpty();
+	return isEmptyRunQueues(&RunQueue::priorityQ);
 }
 
 static boolean putPriorityQueue(Proc* p) {
-	return priorityQ->put(p);
+	pushcli();
+	RunQueue *rq = runQueueFor(p, &RunQueue::priorityQ);
+	acquire(&rq->lock);
+	p->rqcpu = rq->cpu;
+	p->rqweight = getWeight(p);
+	p->rqaffinity = p->affinity;
+	countQueued(rq, p, 1);
+	long long key = getAccumulator(p);
+	boolean ans = rq->priorityQ.put(p, key);
+	if(ans)
+		globalMinPut(key);
+	release(&rq->lock);
+	popcli();
+	return ans;
 }
 
 static boolean getMinAccumulatorPriorityQueue(long long* pkey) {
-	return priorityQ->getMinKey(pkey);
+	acquire(&globalMinLock);
+	boolean cached = globalMinValid;
+	boolean ans = cached && !globalMinNone;
+	if(ans)
+		*pkey = globalMinKey;
+	release(&globalMinLock);
+	if(cached)
+		return ans;
+
+	for(int i = 0; i < ncpu; ++i) //a miss locks every queue, in cpu order, so no put or extract is missed.
+		acquire(&runQueues[i]->lock);
+	for(int i = 0; i < ncpu; ++i) {
+		long long key;
+		if(runQueues[i]->priorityQ.getMinKey(&key) && (!ans || key < *pkey)) {
+			*pkey = key;
+			ans = true;
+		}
+	}
+	acquire(&globalMinLock);
+	globalMinKey = *pkey;
+	globalMinNone = !ans;
+	globalMinValid = true;
+	release(&globalMinLock);
+	for(int i = ncpu - 1; i >= 0; --i)
+		release(&runQueues[i]->lock);
+	return ans;
 }
 
 static Proc* extractMinPriorityQueue() {
-	return priorityQ->extractMin();
+	pushcli();
+	RunQueue *rq = lockRunQueueToRun(&RunQueue::priorityQ);
+	Proc *p = null;
+	if(rq) {
+		globalMinExtract(rq);
+		p = rq->priorityQ.extractMin();
+		if(p)
+			countQueued(rq, p, -1);
+		release(&rq->lock);
+	}
+	popcli();
+	return p;
+}
+
+static Proc* extractGlobalMinPriorityQueue() { //locks every queue, in cpu order, so the minimum can't move meanwhile.
+	RunQueue *min = null;
+	long long minKey = 0;
+	pushcli();
+	int cpu = cpuid();
+	for(int i = 0; i < ncpu; ++i) {
+		long long key;
+		acquire(&runQueues[i]->lock);
+		Proc *next = runQueues[i]->priorityQ.peek();
+		if(next && mayRun(next, cpu) && runQueues[i]->priorityQ.getMinKey(&key) && (!min || key < minKey)) {
+			min = runQueues[i];
+			minKey = key;
+		}
+	}
+
+	if(min)
+		globalMinExtract(min);
+	Proc *p = min ? min->priorityQ.extractMin() : null;
+	if(p)
+		countQueued(min, p, -1);
+	for(int i = ncpu - 1; i >= 0; --i)
+		release(&runQueues[i]->lock);
+	popcli();
+	return p;
+}
+
+static Proc* extractLeastRecentPriorityQueue() { //locks every queue, in cpu order, like extractGlobalMinPriorityQueue.
+	RunQueue *oldest = null;
+	Proc *p = null;
+	pushcli();
+	int cpu = cpuid();
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		Proc *next = runQueues[i]->priorityQ.peekLeastRecent();
+		if(next && mayRun(next, cpu) && (!p || next->last_tq < p->last_tq)) {
+			oldest = runQueues[i];
+			p = next;
+		}
+	}
+
+	if(p) {
+		globalMinExtract(oldest);
+		oldest->priorityQ.extractProc(p);
+		countQueued(oldest, p, -1);
+	}
+	for(int i = ncpu - 1; i >= 0; --i)
+		release(&runQueues[i]->lock);
+	popcli();
+	return p;
 }
 
 static boolean switchToRoundRobinPolicyPriorityQueue() {
-	return priorityQ->transfer();
+	boolean ans = true;
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		ans = runQueues[i]->priorityQ.transfer(&runQueues[i]->roundRobinQ) && ans;
+		globalMinInvalidate();
+		release(&runQueues[i]->lock);
+	}
+	return ans;
 }
 
 static boolean extractProcPriorityQueue(Proc *p) {
-	return priorityQ->extractProc(p);
+	if(!p)
+		return false;
+
+	RunQueue *rq = runQueues[p->rqcpu];
+	acquire(&rq->lock);
+	if(p->rqcpu == rq->cpu)
+		globalMinExtract(rq);
+	boolean ans = p->rqcpu == rq->cpu && rq->priorityQ.extractProc(p); //p may have moved before we got the lock.
+	if(ans)
+		countQueued(rq, p, -1);
+	release(&rq->lock);
+	return ans;
 }
 
 //for rrq
 static boolean isEmptyRoundRobinQueue() {
-	return roundRobinQ->isEmpty();
+	return isEmptyRunQueues(&RunQueue::roundRobinQ);
 }
 
 static boolean enqueueRoundRobinQueue(Proc *p) {
-	return roundRobinQ->enqueue(p);
+	pushcli();
+	RunQueue *rq = runQueueFor(p, &RunQueue::roundRobinQ);
+	acquire(&rq->lock);
+	p->rqcpu = rq->cpu;
+	p->rqweight = getWeight(p);
+	p->rqaffinity = p->affinity;
+	countQueued(rq, p, 1);
+	boolean ans = rq->roundRobinQ.enqueue(p);
+	release(&rq->lock);
+	popcli();
+	return ans;
 }
 
 static Proc* dequeueRoundRobinQueue() {
-	return roundRobinQ->dequeue();
+	pushcli();
+	RunQueue *rq = lockRunQueueToRun(&RunQueue::roundRobinQ);
+	Proc *p = null;
+	if(rq) {
+		p = rq->roundRobinQ.dequeue();
+		if(p)
+			countQueued(rq, p, -1);
+		release(&rq->lock);
+	}
+	popcli();
+	return p;
 }
 
 static boolean switchToPriorityQueuePolicyRoundRobinQueue() {
-	return roundRobinQ->transfer();
+	boolean ans = true;
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		ans = runQueues[i]->roundRobinQ.transfer(&runQueues[i]->priorityQ) && ans;
+		globalMinInvalidate();
+		release(&runQueues[i]->lock);
+	}
+	return ans;
+}
+
+//for mlfq
+static boolean isEmptyMultiLevelQueue() {
+	return isEmptyRunQueues(&RunQueue::multiLevelQ);
+}
+
+static boolean enqueueMultiLevelQueue(Proc *p) {
+	pushcli();
+	RunQueue *rq = runQueueFor(p, &RunQueue::multiLevelQ);
+	acquire(&rq->lock);
+	p->rqcpu = rq->cpu;
+	p->rqweight = getWeight(p);
+	p->rqaffinity = p->affinity;
+	countQueued(rq, p, 1);
+	boolean ans = rq->multiLevelQ.enqueue(p);
+	release(&rq->lock);
+	popcli();
+	return ans;
+}
+
+static Proc* dequeueMultiLevelQueue() {
+	pushcli();
+	RunQueue *rq = lockRunQueueToRun(&RunQueue::multiLevelQ);
+	Proc *p = null;
+	if(rq) {
+		p = rq->multiLevelQ.dequeue();
+		if(p)
+			countQueued(rq, p, -1);
+		release(&rq->lock);
+	}
+	popcli();
+	return p;
+}
+
+static boolean boostMultiLevelQueue() {
+	boolean ans = true;
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		ans = runQueues[i]->multiLevelQ.boost() && ans;
+		release(&runQueues[i]->lock);
+	}
+	return ans;
+}
+
+static boolean switchToRoundRobinPolicyMultiLevelQueue() {
+	boolean ans = true;
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		ans = runQueues[i]->multiLevelQ.transfer(&runQueues[i]->roundRobinQ) && ans;
+		release(&runQueues[i]->lock);
+	}
+	return ans;
+}
+
+static boolean switchFromRoundRobinPolicyMultiLevelQueue() {
+	boolean ans = true;
+	for(int i = 0; i < ncpu; ++i) {
+		acquire(&runQueues[i]->lock);
+		ans = runQueues[i]->multiLevelQ.takeFrom(&runQueues[i]->roundRobinQ) && ans;
+		release(&runQueues[i]->lock);
+	}
+	return ans;
+}
+
+//for rtq
+//Earliest deadline first is global, so there is a single queue rather than one per cpu. Each cpu
+//only takes the procs its cpu is in the affinity mask of, and counts them to know when to halt.
+static void countRealTime(Proc *p, int delta) { //adds delta to the counts of the cpus p may run on.
+	for(int i = 0; i < ncpu; ++i)
+		if(mayRun(p, i))
+			deadlineQueued[i] += delta;
+}
+
+static boolean isEmptyRealTimeQueue() { //is nothing queued that may run on this cpu? A lockless hint, like isEmptyRunQueues.
+	pushcli();
+	boolean ans = !deadlineQueued[cpuid()];
+	popcli();
+	return ans;
+}
+
+static boolean putRealTimeQueue(Proc *p) {
+	acquire(&deadlineLock);
+	boolean ans = deadlineQ->put(p, p->deadline);
+	countRealTime(p, 1);
+	release(&deadlineLock);
+	return ans;
+}
+
+static Proc* extractMinRealTimeQueue() { //the earliest deadline this cpu may run. The earlier ones it skips stay where they are.
+	Proc *p = null;
+	pushcli();
+	int cpu = cpuid();
+	acquire(&deadlineLock);
+	if(deadlineQueued[cpu]) {
+		for(p = deadlineQ->peek(); p && !mayRun(p, cpu); p = deadlineQ->next(p))
+			;
+		if(p) {
+			deadlineQ->extractProc(p);
+			countRealTime(p, -1);
+		}
+	}
+	release(&deadlineLock);
+	popcli();
+	return p;
+}
+
+static boolean extractProcRealTimeQueue(Proc *p) {
+	acquire(&deadlineLock);
+	boolean ans = deadlineQ->extractProc(p);
+	if(ans)
+		countRealTime(p, -1);
+	release(&deadlineLock);
+	return ans;
 }
 
 //for rpholder
@@ -112,7 +512,7 @@ static boolean isEmptyRunningProcessHolder() {
 }
 
 static boolean addRunningProcessHolder(Proc* p) {
-	return runningProcHolder->enqueue(p);
+	return runningProcHolder->add(p);
 }
 
 static boolean removeRunningProcessHolder(Proc* p) {
@@ -123,40 +523,34 @@ static boolean getMinAccumulatorRunningProcessHolder(long long *pkey) {
 	return runningProcHolder->getMinKey(pkey);
 }
 
-void initSchedDS() { //called once by the "pioneer" cpu from the main function in main.c
-	data               = null;
-	spaceLeft          = 0u;
-
-	priorityQ          = (Map*)mymalloc(sizeof(Map));
-	*priorityQ         = Map();
+static void rekeyRunningProcessHolder() {
+	runningProcHolder->rekey();
+}
 
-	roundRobinQ        = (LinkedList*)mymalloc(sizeof(LinkedList));
-	*roundRobinQ       = LinkedList();
+void initSchedDS() { //called once by the "pioneer" cpu from the main function in main.c
+	for(int i = 0; i < NCPU; ++i) {
+		runQueues[i]   = (RunQueue*)runQueueStore[i];
+		*runQueues[i]  = RunQueue(i);
+		initlock(&runQueues[i]->lock, (char*)"runqueue");
+	}
 
-	runningProcHolder  = (LinkedList*)mymalloc(sizeof(LinkedList));
-	*runningProcHolder = LinkedList();
+	runningProcHolder = (ProcHeap<NCPU>*)runningProcHolderStore;
+	*runningProcHolder = ProcHeap<NCPU>(&Proc::rpnode);
 
-	freeLinks = null;
-	for(int i = 0; i < NPROCLIST; ++i) {
-		Link *link = (Link*)mymalloc(sizeof(Link));
-		*link = Link();
-		link->next = freeLinks;
-		freeLinks = link;
-	}
+	deadlineQ = (DeadlineMap*)deadlineQStore;
+	*deadlineQ = DeadlineMap();
+	initlock(&deadlineLock, (char*)"deadline");
 
-	freeNodes = null;
-	for(int i = 0; i < NPROCMAP; ++i) {
-		MapNode *node = (MapNode*)mymalloc(sizeof(MapNode));
-		*node = MapNode();
-		node->next = freeNodes;
-		freeNodes = node;
-	}
+	globalMinValid = globalMinNone = true; //every priority queue is empty.
+	initlock(&globalMinLock, (char*)"minkey");
 
 	//init pq
 	pq.isEmpty                      = isEmptyPriorityQueue;
 	pq.put                          = putPriorityQueue;
 	pq.getMinAccumulator            = getMinAccumulatorPriorityQueue;
 	pq.extractMin                   = extractMinPriorityQueue;
+	pq.extractGlobalMin             = extractGlobalMinPriorityQueue;
+	pq.extractLeastRecent           = extractLeastRecentPriorityQueue;
 	pq.switchToRoundRobinPolicy     = switchToRoundRobinPolicyPriorityQueue;
 	pq.extractProc                  = extractProcPriorityQueue;
 
@@ -166,302 +560,1169 @@ void initSchedDS() { //called once by the "pioneer" cpu from the main function i
 	rrq.dequeue                     = dequeueRoundRobinQueue;
 	rrq.switchToPriorityQueuePolicy = switchToPriorityQueuePolicyRoundRobinQueue;
 
+	//init mlfq
+	mlfq.isEmpty                    = isEmptyMultiLevelQueue;
+	mlfq.enqueue                    = enqueueMultiLevelQueue;
+	mlfq.dequeue                    = dequeueMultiLevelQueue;
+	mlfq.boost                      = boostMultiLevelQueue;
+	mlfq.switchToRoundRobinPolicy   = switchToRoundRobinPolicyMultiLevelQueue;
+	mlfq.switchFromRoundRobinPolicy = switchFromRoundRobinPolicyMultiLevelQueue;
+
+	//init rtq
+	rtq.isEmpty                     = isEmptyRealTimeQueue;
+	rtq.put                         = putRealTimeQueue;
+	rtq.extractMin                  = extractMinRealTimeQueue;
+	rtq.extractProc                 = extractProcRealTimeQueue;
+
 	//init rpholder
 	rpholder.isEmpty                = isEmptyRunningProcessHolder;
 	rpholder.add                    = addRunningProcessHolder;
 	rpholder.remove                 = removeRunningProcessHolder;
 	rpholder.getMinAccumulator      = getMinAccumulatorRunningProcessHolder;
+	rpholder.rekey                  = rekeyRunningProcessHolder;
 }
 
-static Link* allocLink(Proc *p) {
-	if(!freeLinks)
-		return null;
-
-	Link *ans = freeLinks;
-	freeLinks = freeLinks->next;
-	ans->next = null;
-	ans->p = p;
-	return ans;
+void dumpSchedDS() { //called by procdump. No locks, like procdump itself.
+	for(int i = 0; i < ncpu; ++i) {
+		cprintf((char*)"cpu %d: %d round robin, %d priority, %d multilevel queued. ", i,
+			runQueues[i]->roundRobinQ.getSize(), runQueues[i]->priorityQ.getSize(),
+			runQueues[i]->multiLevelQ.getSize());
+		lockdump(&runQueues[i]->lock);
+	}
+	cprintf((char*)"%d real-time queued. ", deadlineQ->getSize());
+	lockdump(&deadlineLock);
 }
 
-static void deallocLink(Link *link) {
-	link->next = freeLinks;
-	freeLinks = link;
+int sizeSchedDS(int cpu) { //the number of procs queued to run on the given cpu. A lockless hint, like isEmpty.
+	RunQueue *rq = runQueues[cpu];
+	return rq->roundRobinQ.getSize() + rq->priorityQ.getSize() + rq->multiLevelQ.getSize();
 }
 
-static void deallocNode(MapNode *node) {
-	node->parent = node->left = node->right = null;
-	node->next = freeNodes;
-	freeNodes = node;
+int balanceSchedDS() { //moves procs from the most loaded run queue to the least loaded one. Returns how many.
+	RunQueue *busiest = null, *idlest = null;
+	for(int i = 0; i < ncpu; ++i) { //loads are only hints until both locks are held, like the sizes.
+		if(!busiest || runQueues[i]->load > busiest->load)
+			busiest = runQueues[i];
+		if(!idlest || runQueues[i]->load < idlest->load)
+			idlest = runQueues[i];
+	}
+	if(busiest == idlest)
+		return 0;
+
+	RunQueue *first = busiest->cpu < idlest->cpu ? busiest : idlest; //cpu order, like extractGlobalMinPriorityQueue.
+	RunQueue *second = first == busiest ? idlest : busiest;
+	acquire(&first->lock);
+	acquire(&second->lock);
+
+	//move up to BALANCE_BATCH procs that may run on the idlest cpu, as long as each one brings
+	//the loads closer.
+	int imbalance = (busiest->load - idlest->load) / 2;
+	int moved = 0;
+	auto take = [&](Proc *p) {
+		if(moved == BALANCE_BATCH || p->rqweight > imbalance || !mayRun(p, idlest->cpu))
+			return false;
+		imbalance -= p->rqweight;
+		countQueued(busiest, p, -1);
+		countQueued(idlest, p, 1);
+		p->rqcpu = idlest->cpu;
+		++moved;
+		return true;
+	};
+	busiest->roundRobinQ.moveIf(&idlest->roundRobinQ, take);
+	busiest->priorityQ.moveIf(&idlest->priorityQ, take);
+	busiest->multiLevelQ.moveIf(&idlest->multiLevelQ, take);
+
+	release(&second->lock);
+	release(&first->lock);
+	return moved;
 }
 
-static MapNode* allocNode(long long key) {
-	if(!freeNodes)
-		return null;
+bool LinkedList::isEmpty() {
+	return !first;
+}
 
-	MapNode *ans = freeNodes;
-	freeNodes = freeNodes->next;
-	ans->next = null;
-	ans->key = key;
-	return ans;
+bool LinkedList::contains(Proc *p) {
+	return (p->*hook).prev || first == p;
 }
 
-static MapNode* allocNode(Proc *p, long long key) {
-	if(!freeNodes)
-		return null;
+bool LinkedList::enqueue(Proc *p) {
+	SchedLink &link = p->*hook;
+	link.next = null;
+	link.prev = last;
 
-	MapNode *ans = allocNode(key);
-	if(!ans)
-		return null;
+	if(isEmpty()) first = p;
+	else (last->*hook).next = p;
 
-	if(!ans->listOfProcs.enqueue(p)) {
-		deallocNode(ans);
+	last = p;
+	++size;
+	return true;
+}
+
+Proc* LinkedList::dequeue() {
+	if(isEmpty())
 		return null;
-	}
 
-	return ans;
+	Proc *p = first;
+	remove(p);
+	return p;
 }
 
-Link* Link::getLast() {
-	Link* ans = this;
-	
-	while(ans->next)
-		ans = ans->next;
+Proc* LinkedList::peek() {
+	return first;
+}
 
-	return ans;
+bool LinkedList::remove(Proc *p) {
+	if(!contains(p))
+		return false;
+
+	SchedLink &link = p->*hook;
+	if(link.prev) (link.prev->*hook).next = link.next;
+	else first = link.next;
+
+	if(link.next) (link.next->*hook).prev = link.prev;
+	else last = link.prev;
+
+	link.next = link.prev = null;
+	--size;
+	return true;
 }
 
-bool LinkedList::isEmpty() {
-	return !first;
+int LinkedList::getSize() {
+	return size;
 }
 
-void LinkedList::append(Link *link) {
-	if(!link)
+void LinkedList::append(LinkedList *other) {
+	if(other->isEmpty())
 		return;
 
-	if(isEmpty()) first = link;
-	else last->next = link;
+	if(isEmpty()) first = other->first;
+	else {
+		(last->*hook).next = other->first;
+		(other->first->*hook).prev = last;
+	}
 
-	last = link->getLast();
+	last = other->last;
+	size += other->size;
+	other->first = other->last = null;
+	other->size = 0;
 }
 
-bool LinkedList::enqueue(Proc *p) {
-	Link *link = allocLink(p);
-	
-	if(!link)
+bool LinkedList::transfer(PriorityMap *target) {
+	return target->build(this, 0); //keeps the round robin order, since equal keys are FIFO.
+}
+
+bool LinkedList::getMinKey(long long *pkey) {
+	if(isEmpty())
 		return false;
 
-	append(link);
+	long long minKey = getAccumulator(first);
+	
+	forEach([&](Proc *p) {
+		long long key = getAccumulator(p);
+		if(key < minKey)
+			minKey = key;
+	});
+
+	*pkey = minKey;
+	
 	return true;
 }
 
-Proc* LinkedList::dequeue() {
+bool MultiLevelQueue::isEmpty() {
+	return !bitmap;
+}
+
+bool MultiLevelQueue::enqueue(Proc *p) {
+	int level = p->level < MLFQ_LEVELS ? p->level : MLFQ_LEVELS - 1;
+	levels[level].enqueue(p);
+	bitmap |= 1u << level;
+	++size;
+	return true;
+}
+
+Proc* MultiLevelQueue::dequeue() {
 	if(isEmpty())
 		return null;
 
-	Proc *p = first->p;
-	Link *next = first->next;
-	
-	deallocLink(first);
-	
-	first = next;
+	int level = __builtin_ctz(bitmap); //the highest non-empty level, a single bsf.
+	Proc *p = levels[level].dequeue();
+	if(levels[level].isEmpty())
+		bitmap &= ~(1u << level);
+	--size;
+	return p;
+}
 
-	if(isEmpty())
-		last = null;
-	
+Proc* MultiLevelQueue::peek() {
+	return bitmap ? levels[__builtin_ctz(bitmap)].peek() : null;
+}
+
+int MultiLevelQueue::getSize() {
+	return size;
+}
+
+bool MultiLevelQueue::boost() {
+	for(int level = 1; level < MLFQ_LEVELS; ++level)
+		levels[0].append(&levels[level]);
+
+	bitmap = levels[0].isEmpty() ? 0 : 1;
+	return true;
+}
+
+bool MultiLevelQueue::transfer(LinkedList *target) {
+	if(!target->isEmpty())
+		return false;
+
+	for(int level = 0; level < MLFQ_LEVELS; ++level)
+		target->append(&levels[level]);
+
+	bitmap = 0;
+	size = 0;
+	return true;
+}
+
+bool MultiLevelQueue::takeFrom(LinkedList *source) {
+	if(!isEmpty())
+		return false;
+
+	levels[0].append(source);
+	size = levels[0].getSize();
+	bitmap = size ? 1 : 0;
+	return true;
+}
+
+//fill() and drain() move a whole structure's worth of procs between a Map's backend and a list, for
+//the policy switches. The defaults go one proc at a time. With all the keys equal, inserting is
+//O(1) for the heaps, while extracting them in order is inherently O(n log n).
+template<typename Backend>
+static bool fill(Backend &backend, LinkedList *source, long long key) {
+	bool ans = true;
+	while(!source->isEmpty())
+		ans = backend.insert(source->dequeue(), key) && ans;
+	return ans;
+}
+
+static inline bool fill(RBTree &tree, LinkedList *source, long long key) {
+	return tree.build(source, key);
+}
+
+template<typename Backend>
+static void drain(Backend &backend, LinkedList *target) {
+	while(!backend.isEmpty())
+		target->enqueue(backend.extractMin());
+}
+
+static inline void drain(RBTree &tree, LinkedList *target) {
+	tree.flatten(target);
+}
+
+template<typename Backend>
+bool Map<Backend>::isEmpty() {
+	return backend.isEmpty();
+}
+
+template<typename Backend>
+bool Map<Backend>::put(Proc *p) {
+	return insert(p, getAccumulator(p));
+}
+
+template<typename Backend>
+bool Map<Backend>::put(Proc *p, long long key) {
+	return insert(p, key);
+}
+
+template<typename Backend>
+bool Map<Backend>::insert(Proc *p, long long key) {
+	return backend.insert(p, key) && aging.insert(p, p->last_tq);
+}
+
+template<typename Backend>
+bool Map<Backend>::relink(Proc *p) {
+	return backend.relink(p) && aging.insert(p, p->last_tq);
+}
+
+template<typename Backend>
+bool Map<Backend>::build(LinkedList *source, long long key) {
+	if(!isEmpty())
+		return false;
+
+	source->forEach([&](Proc *p) {
+		aging.insert(p, p->last_tq);
+	});
+	return fill(backend, source, key);
+}
+
+template<typename Backend>
+bool Map<Backend>::getMinKey(long long *pkey) {
+	return backend.getMinKey(pkey);
+}
+
+template<typename Backend>
+Proc* Map<Backend>::peek() {
+	return backend.peek();
+}
+
+template<typename Backend>
+Proc* Map<Backend>::next(Proc *p) {
+	return backend.next(p);
+}
+
+template<typename Backend>
+Proc* Map<Backend>::extractMin() {
+	Proc *p = backend.extractMin();
+	if(p)
+		aging.extractProc(p);
 	return p;
 }
 
-bool LinkedList::remove(Proc *p) {
-	if(isEmpty())
+template<typename Backend>
+Proc* Map<Backend>::peekLeastRecent() {
+	return aging.peek();
+}
+
+template<typename Backend>
+bool Map<Backend>::transfer(LinkedList *target) {
+	if(!target->isEmpty())
 		return false;
-	
-	if(first->p == p) {
-		dequeue();
-		return true;
-	}
 
-	Link *prev = first;
-	Link *cur = first->next;
-	while(cur) {
-		if(cur->p == p) {
-			prev->next = cur->next;
-			
-			if(!(cur->next)) //removes the last link
-				last = prev;
+	drain(backend, target);
+	while(aging.extractMin());
+	return true;
+}
 
-			deallocLink(cur);
+template<typename Backend>
+bool Map<Backend>::extractProc(Proc *p) {
+	if(!p || !backend.extractProc(p))
+		return false;
+	aging.extractProc(p);
+	return true;
+}
 
-			return true;
-		}
+template<typename Backend>
+int Map<Backend>::getSize() {
+	return backend.getSize();
+}
+
+bool RBTree::isEmpty() {
+	return !root;
+}
+
+bool RBTree::contains(Proc *p) {
+	return (p->*hook).parent || root == p;
+}
+
+bool RBTree::less(Proc *a, Proc *b) {
+	if((a->*hook).key != (b->*hook).key)
+		return (a->*hook).key < (b->*hook).key;
 
-		prev = cur;
-		cur = cur->next;
+	return (a->*hook).seq < (b->*hook).seq;
+}
+
+Proc* RBTree::getMinNode(Proc *node) { //no recursion.
+	while((node->*hook).left)
+		node = (node->*hook).left;
+
+	return node;
+}
+
+bool RBTree::insert(Proc *p, long long key) {
+	(p->*hook).key = key;
+	(p->*hook).seq = seq++;
+	return relink(p);
+}
+
+bool RBTree::relink(Proc *p) { //we can not use recursion, since the stack of xv6 is too small....
+	(p->*hook).left = (p->*hook).right = null;
+	(p->*hook).red = true; //new nodes are always linked as red leaves.
+
+	Proc *parent = null;
+	Proc *node = root;
+	while(node) {
+		parent = node;
+		node = less(p, node) ? (node->*hook).left : (node->*hook).right;
 	}
 
-	//didn't find the process
-	return false;
+	(p->*hook).parent = parent;
+	if(!parent) root = p;
+	else if(less(p, parent)) (parent->*hook).left = p;
+	else (parent->*hook).right = p;
+	if(!leftmost || less(p, leftmost))
+		leftmost = p;
+
+	insertFixup(p);
+	++size;
+	return true;
+}
+
+Proc* RBTree::next(Proc *p) {
+	if((p->*hook).right)
+		return getMinNode((p->*hook).right);
+
+	Proc *parent = (p->*hook).parent; //up until p is in a left subtree
+	while(parent && p == (parent->*hook).right) {
+		p = parent;
+		parent = (parent->*hook).parent;
+	}
+	return parent;
 }
 
-bool LinkedList::transfer() {
-	if(!priorityQ->isEmpty())
+bool RBTree::verify() {
+	if(!root)
+		return !leftmost && !size;
+	if((root->*hook).parent || (root->*hook).red || leftmost != getMinNode(root))
 		return false;
-	
-	if(!isEmpty()) {
-		MapNode *node = allocNode(0);
-		if(!node)
+
+	int bits = 0; //a red-black tree of n nodes is at most 2*log2(n+1) high.
+	for(int n = size + 1; n; n >>= 1)
+		++bits;
+
+	int count = 0, blacks = -1;
+	for(Proc *p = leftmost, *prev = null; p; prev = p, p = next(p)) {
+		SchedTree &links = p->*hook;
+		++count;
+		if(prev && !less(prev, p))
+			return false;
+		if((links.left && (links.left->*hook).parent != p) || (links.right && (links.right->*hook).parent != p))
 			return false;
-		
-		node->listOfProcs.first = first;
-		node->listOfProcs.last = last;
-		first = last = null;
-		priorityQ->root = node;
+		if(links.red && ((links.left && (links.left->*hook).red) || (links.right && (links.right->*hook).red)))
+			return false;
+		if(links.left && links.right)
+			continue;
+
+		int black = 0, depth = 0; //p ends a path, which must have as many black nodes as the others.
+		for(Proc *node = p; node; node = (node->*hook).parent, ++depth)
+			if(!(node->*hook).red)
+				++black;
+		if((blacks >= 0 && black != blacks) || depth > 2 * bits)
+			return false;
+		blacks = black;
 	}
-	return true;
+	return count == size;
 }
 
-bool LinkedList::getMinKey(long long *pkey) {
+bool RBTree::getMinKey(long long *pkey) {
 	if(isEmpty())
 		return false;
 
-	long long minKey = getAccumulator(first->p);
-	
-	forEach([&](Proc *p) {
-		long long key = getAccumulator(p);
-		if(key < minKey)
-			minKey = key;
-	});
+	*pkey = (leftmost->*hook).key;
+	return true;
+}
 
-	*pkey = minKey;
-	
+Proc* RBTree::peek() {
+	return leftmost;
+}
+
+Proc* RBTree::extractMin() {
+	if(isEmpty())
+		return null;
+
+	Proc *p = leftmost;
+	removeNode(p);
+	return p;
+}
+
+bool RBTree::extractProc(Proc *p) {
+	if(!p || !contains(p))
+		return false;
+
+	removeNode(p);
 	return true;
 }
 
-bool MapNode::isEmpty() {
-	return listOfProcs.isEmpty();
+void RBTree::rotateLeft(Proc *node) {
+	Proc *child = (node->*hook).right;
+
+	(node->*hook).right = (child->*hook).left;
+	if((child->*hook).left)
+		((child->*hook).left->*hook).parent = node;
+
+	Proc *parent = (node->*hook).parent;
+	(child->*hook).parent = parent;
+	if(!parent) root = child;
+	else if(node == (parent->*hook).left) (parent->*hook).left = child;
+	else (parent->*hook).right = child;
+
+	(child->*hook).left = node;
+	(node->*hook).parent = child;
 }
 
-bool MapNode::put(Proc *p) { //we can not use recursion, since the stack of xv6 is too small....
-	MapNode *node = this;
-	long long key = getAccumulator(p);
-	for(;;) {
-		if(key == node->key)
-			return node->listOfProcs.enqueue(p);
-		else if(key < node->key) { //left
-			if(node->left)
-				node = node->left;
-			else {
-				node->left = allocNode(p, key);
-				if(node->left) {
-					node->left->parent = node;
-					return true;
-				}
-				return false;
+void RBTree::rotateRight(Proc *node) {
+	Proc *child = (node->*hook).left;
+
+	(node->*hook).left = (child->*hook).right;
+	if((child->*hook).right)
+		((child->*hook).right->*hook).parent = node;
+
+	Proc *parent = (node->*hook).parent;
+	(child->*hook).parent = parent;
+	if(!parent) root = child;
+	else if(node == (parent->*hook).right) (parent->*hook).right = child;
+	else (parent->*hook).left = child;
+
+	(child->*hook).right = node;
+	(node->*hook).parent = child;
+}
+
+bool RBTree::isRed(Proc *node) { //null children count as black.
+	return node && (node->*hook).red;
+}
+
+void RBTree::insertFixup(Proc *node) { //no recursion, at most 2 rotations.
+	while(isRed((node->*hook).parent)) {
+		Proc *parent = (node->*hook).parent;
+		Proc *grandparent = (parent->*hook).parent; //exists, since a red node is never the root.
+
+		if(parent == (grandparent->*hook).left) {
+			Proc *uncle = (grandparent->*hook).right;
+			if(isRed(uncle)) { //recolor and continue from the grandparent.
+				(parent->*hook).red = (uncle->*hook).red = false;
+				(grandparent->*hook).red = true;
+				node = grandparent;
+				continue;
+			}
+
+			if(node == (parent->*hook).right) {
+				rotateLeft(parent);
+				node = parent;
+				parent = (node->*hook).parent;
+			}
+
+			(parent->*hook).red = false;
+			(grandparent->*hook).red = true;
+			rotateRight(grandparent);
+		} else { //mirror image of the above.
+			Proc *uncle = (grandparent->*hook).left;
+			if(isRed(uncle)) {
+				(parent->*hook).red = (uncle->*hook).red = false;
+				(grandparent->*hook).red = true;
+				node = grandparent;
+				continue;
 			}
-		} else { //right
-			if(node->right)
-				node = node->right;
-			else {
-				node->right = allocNode(p, key);
-				if(node->right) {
-					node->right->parent = node;
-					return true;
-				}
-				return false;
+
+			if(node == (parent->*hook).left) {
+				rotateRight(parent);
+				node = parent;
+				parent = (node->*hook).parent;
 			}
+
+			(parent->*hook).red = false;
+			(grandparent->*hook).red = true;
+			rotateLeft(grandparent);
 		}
 	}
+
+	(root->*hook).red = false;
 }
 
-MapNode* MapNode::getMinNode() { //no recursion.
-	MapNode* minNode = this;	
-	while(minNode->left)
-		minNode = minNode->left;
+void RBTree::removeNode(Proc *node) {
+	Proc *child, *parent;
+	bool removedRed;
+	SchedTree &links = node->*hook;
+
+	if(node == leftmost) //it has no left child, so its successor is the right subtree's min, or else its parent.
+		leftmost = links.right ? getMinNode(links.right) : links.parent;
+
+	if(links.left && links.right) { //splice out the successor and put it in node's place.
+		Proc *successor = getMinNode(links.right);
+		removedRed = (successor->*hook).red;
+		child = (successor->*hook).right;
+
+		if((successor->*hook).parent == node)
+			parent = successor;
+		else {
+			parent = (successor->*hook).parent;
+			(parent->*hook).left = child;
+			if(child)
+				(child->*hook).parent = parent;
+			(successor->*hook).right = links.right;
+			(links.right->*hook).parent = successor;
+		}
+
+		(successor->*hook).left = links.left;
+		(links.left->*hook).parent = successor;
+		(successor->*hook).parent = links.parent;
+		(successor->*hook).red = links.red;
+
+		if(!links.parent) root = successor;
+		else if(node == (links.parent->*hook).left) (links.parent->*hook).left = successor;
+		else (links.parent->*hook).right = successor;
+	} else { //at most one child, which replaces node.
+		removedRed = links.red;
+		child = links.left ? links.left : links.right;
+		parent = links.parent;
+
+		if(child)
+			(child->*hook).parent = parent;
+
+		if(!parent) root = child;
+		else if(node == (parent->*hook).left) (parent->*hook).left = child;
+		else (parent->*hook).right = child;
+	}
+
+	links.parent = links.left = links.right = null;
+	--size;
 
-	return minNode;
+	if(!removedRed)
+		removeFixup(child, parent);
 }
 
-void MapNode::getMinKey(long long *pkey) {
-	*pkey = getMinNode()->key;
+int RBTree::getSize() {
+	return size;
 }
 
-Proc* MapNode::dequeue() {
-	return listOfProcs.dequeue();
+//The tree splits the procs evenly at every node, so every path down to a null passes the
+//same number of nodes above the deepest level. Coloring just that level red makes it a
+//valid red-black tree. The recursion is unrolled onto a small array of frames.
+bool RBTree::build(LinkedList *source, long long key) {
+	if(!isEmpty())
+		return false;
+
+	struct Frame {
+		int size; //the procs of this subtree
+		int depth;
+		Proc *node; //the subtree's root, once its left subtree is built
+		bool started; //was the left subtree pushed?
+	} frames[BUILD_DEPTH];
+	int n = source->getSize();
+	int deepest = 0;
+	for(int left = n; left > 1; left >>= 1)
+		++deepest;
+
+	Proc *built = null; //the subtree the last popped frame built
+	int top = 0;
+	frames[top++] = {n, 0, null, false};
+	while(top) {
+		Frame &f = frames[top - 1];
+		if(!f.size) {
+			built = null;
+			--top;
+		} else if(!f.started) { //the smaller half goes left.
+			f.started = true;
+			frames[top++] = {(f.size - 1) / 2, f.depth + 1, null, false};
+		} else if(!f.node) { //the left subtree is built, the next proc is this subtree's root.
+			Proc *p = source->dequeue();
+			(p->*hook).key = key;
+			(p->*hook).seq = seq++;
+			(p->*hook).parent = null;
+			(p->*hook).left = built;
+			(p->*hook).red = f.depth == deepest && f.depth > 0;
+			if(built)
+				(built->*hook).parent = p;
+			if(!leftmost)
+				leftmost = p;
+			f.node = p;
+			frames[top++] = {f.size - 1 - (f.size - 1) / 2, f.depth + 1, null, false};
+		} else {
+			(f.node->*hook).right = built;
+			if(built)
+				(built->*hook).parent = f.node;
+			built = f.node;
+			--top;
+		}
+	}
+
+	root = built;
+	size = n;
+	return true;
+}
+
+void RBTree::flatten(LinkedList *target) { //rotates each left child up until the root has none, then takes the root. No parent links needed.
+	Proc *node = root;
+	while(node) {
+		Proc *left = (node->*hook).left;
+		if(left) {
+			(node->*hook).left = (left->*hook).right;
+			(left->*hook).right = node;
+			node = left;
+		} else {
+			Proc *next = (node->*hook).right;
+			(node->*hook).parent = (node->*hook).right = null;
+			target->enqueue(node);
+			node = next;
+		}
+	}
+
+	root = leftmost = null;
+	size = 0;
+}
+
+void RBTree::removeFixup(Proc *node, Proc *parent) { //no recursion, at most 3 rotations.
+	while(node != root && !isRed(node)) {
+		if(node == (parent->*hook).left) {
+			Proc *sibling = (parent->*hook).right; //exists, since node's side is short by one black node.
+			if(isRed(sibling)) {
+				(sibling->*hook).red = false;
+				(parent->*hook).red = true;
+				rotateLeft(parent);
+				sibling = (parent->*hook).right;
+			}
+
+			if(!isRed((sibling->*hook).left) && !isRed((sibling->*hook).right)) {
+				(sibling->*hook).red = true;
+				node = parent;
+				parent = (node->*hook).parent;
+				continue;
+			}
+
+			if(!isRed((sibling->*hook).right)) {
+				((sibling->*hook).left->*hook).red = false;
+				(sibling->*hook).red = true;
+				rotateRight(sibling);
+				sibling = (parent->*hook).right;
+			}
+
+			(sibling->*hook).red = (parent->*hook).red;
+			(parent->*hook).red = false;
+			((sibling->*hook).right->*hook).red = false;
+			rotateLeft(parent);
+			node = root;
+		} else { //mirror image of the above.
+			Proc *sibling = (parent->*hook).left;
+			if(isRed(sibling)) {
+				(sibling->*hook).red = false;
+				(parent->*hook).red = true;
+				rotateRight(parent);
+				sibling = (parent->*hook).left;
+			}
+
+			if(!isRed((sibling->*hook).left) && !isRed((sibling->*hook).right)) {
+				(sibling->*hook).red = true;
+				node = parent;
+				parent = (node->*hook).parent;
+				continue;
+			}
+
+			if(!isRed((sibling->*hook).left)) {
+				((sibling->*hook).right->*hook).red = false;
+				(sibling->*hook).red = true;
+				rotateLeft(sibling);
+				sibling = (parent->*hook).left;
+			}
+
+			(sibling->*hook).red = (parent->*hook).red;
+			(parent->*hook).red = false;
+			((sibling->*hook).left->*hook).red = false;
+			rotateRight(parent);
+			node = root;
+		}
+	}
+
+	if(node)
+		(node->*hook).red = false;
 }
 
-bool Map::isEmpty() {
+bool PairingHeap::isEmpty() {
 	return !root;
 }
 
-bool Map::put(Proc *p) {
-	long long key = getAccumulator(p);
-	if(isEmpty()) {
-		root = allocNode(p, key);
-		return !isEmpty();
+int PairingHeap::getSize() {
+	return size;
+}
+
+bool PairingHeap::contains(Proc *p) {
+	return p->pqpair.prev || root == p;
+}
+
+bool PairingHeap::less(Proc *a, Proc *b) {
+	if(a->pqpair.key != b->pqpair.key)
+		return a->pqpair.key < b->pqpair.key;
+
+	return a->pqpair.seq < b->pqpair.seq;
+}
+
+Proc* PairingHeap::meld(Proc *a, Proc *b) { //a and b are roots, their own sibling links are ignored.
+	if(less(b, a)) {
+		Proc *tmp = a;
+		a = b;
+		b = tmp;
 	}
-	
-	return root->put(p);
+
+	b->pqpair.next = a->pqpair.child;
+	if(a->pqpair.child)
+		a->pqpair.child->pqpair.prev = b;
+	b->pqpair.prev = a;
+	a->pqpair.child = b;
+	return a;
+}
+
+Proc* PairingHeap::mergePairs(Proc *first) { //no recursion.
+	if(!first)
+		return null;
+
+	//first pass: meld the siblings in pairs from left to right, stacking the results through next.
+	Proc *pairs = null;
+	while(first) {
+		Proc *a = first;
+		Proc *b = a->pqpair.next;
+		first = b ? b->pqpair.next : null;
+
+		if(b)
+			a = meld(a, b);
+		a->pqpair.next = pairs;
+		pairs = a;
+	}
+
+	//second pass: meld the pairs into one tree from right to left.
+	Proc *tree = pairs;
+	pairs = pairs->pqpair.next;
+	while(pairs) {
+		Proc *next = pairs->pqpair.next;
+		tree = meld(tree, pairs);
+		pairs = next;
+	}
+
+	tree->pqpair.next = tree->pqpair.prev = null;
+	return tree;
+}
+
+bool PairingHeap::insert(Proc *p, long long key) {
+	p->pqpair.key = key;
+	p->pqpair.seq = seq++;
+	return relink(p);
 }
 
-bool Map::getMinKey(long long *pkey) {
+bool PairingHeap::relink(Proc *p) {
+	p->pqpair.child = p->pqpair.next = p->pqpair.prev = null;
+
+	root = root ? meld(root, p) : p;
+	++size;
+	return true;
+}
+
+bool PairingHeap::getMinKey(long long *pkey) {
 	if(isEmpty())
 		return false;
 
-	root->getMinKey(pkey);
+	*pkey = root->pqpair.key;
 	return true;
 }
 
-Proc* Map::extractMin() {
+Proc* PairingHeap::peek() {
+	return root;
+}
+
+Proc* PairingHeap::extractMin() {
 	if(isEmpty())
 		return null;
 
-	MapNode *minNode = root->getMinNode();
+	Proc *p = root;
+	root = mergePairs(p->pqpair.child);
+	p->pqpair.child = null;
+	--size;
+	return p;
+}
 
-	Proc *p = minNode->dequeue();
-	
-	if(minNode->isEmpty()) {
-		if(minNode == root) {
-			root = minNode->right;
-			if(!isEmpty())
-				root->parent = null;
-		} else {
-			MapNode *parent = minNode->parent;
-			parent->left = minNode->right;
-			if(minNode->right)
-				minNode->right->parent = parent;
+void PairingHeap::unlink(Proc *p) {
+	Proc *prev = p->pqpair.prev;
+	if(prev->pqpair.child == p) prev->pqpair.child = p->pqpair.next;
+	else prev->pqpair.next = p->pqpair.next;
+
+	if(p->pqpair.next)
+		p->pqpair.next->pqpair.prev = prev;
+
+	p->pqpair.next = p->pqpair.prev = null;
+}
+
+bool PairingHeap::extractProc(Proc *p) {
+	if(!contains(p))
+		return false;
+
+	if(p == root) {
+		extractMin();
+		return true;
+	}
+
+	unlink(p);
+	Proc *subtree = mergePairs(p->pqpair.child);
+	p->pqpair.child = null;
+	if(subtree)
+		root = meld(root, subtree);
+	--size;
+	return true;
+}
+
+bool RadixHeap::isEmpty() {
+	return !size;
+}
+
+int RadixHeap::getSize() {
+	return size;
+}
+
+int RadixHeap::bucketOf(long long key) {
+	unsigned long long diff = (unsigned long long)key ^ (unsigned long long)last;
+	return diff ? 64 - __builtin_clzll(diff) : 0;
+}
+
+void RadixHeap::link(Proc *p, int bucket) {
+	Proc *head = first[bucket];
+	if(!head) {
+		first[bucket] = p->pqbucket.next = p->pqbucket.prev = p;
+	} else {
+		p->pqbucket.next = head;
+		p->pqbucket.prev = head->pqbucket.prev;
+		head->pqbucket.prev->pqbucket.next = p;
+		head->pqbucket.prev = p;
+	}
+	p->pqbucket.bucket = bucket + 1;
+}
+
+void RadixHeap::unlink(Proc *p) {
+	int bucket = p->pqbucket.bucket - 1;
+	if(p->pqbucket.next == p)
+		first[bucket] = null;
+	else {
+		p->pqbucket.prev->pqbucket.next = p->pqbucket.next;
+		p->pqbucket.next->pqbucket.prev = p->pqbucket.prev;
+		if(first[bucket] == p)
+			first[bucket] = p->pqbucket.next;
+	}
+	p->pqbucket.next = p->pqbucket.prev = null;
+	p->pqbucket.bucket = 0;
+}
+
+bool RadixHeap::insert(Proc *p, long long key) {
+	if(key < last)
+		rebase(key);
+
+	p->pqbucket.key = key;
+	link(p, bucketOf(key));
+	++size;
+	return true;
+}
+
+bool RadixHeap::relink(Proc *p) {
+	long long key = p->pqbucket.key;
+	if(key < last)
+		rebase(key);
+
+	int bucket = bucketOf(key);
+	link(p, bucket);
+	first[bucket] = p; //the buckets are circular, so the appended p becomes the first.
+	++size;
+	return true;
+}
+
+void RadixHeap::settle() {
+	if(first[0])
+		return;
+
+	int bucket = 1;
+	while(!first[bucket])
+		++bucket;
+
+	Proc *p = first[bucket];
+	long long minKey = p->pqbucket.key;
+	for(p = p->pqbucket.next; p != first[bucket]; p = p->pqbucket.next)
+		if(p->pqbucket.key < minKey)
+			minKey = p->pqbucket.key;
+
+	//every proc of the bucket moves to a lower one, since they all share the bits above bucket-1.
+	last = minKey;
+	Proc *next = first[bucket];
+	while(first[bucket]) {
+		p = next;
+		next = p->pqbucket.next;
+		unlink(p);
+		link(p, bucketOf(p->pqbucket.key));
+	}
+}
+
+void RadixHeap::rebase(long long key) {
+	last = key;
+	for(int bucket = 0; bucket < NBUCKETS; ++bucket) {
+		Proc *p = first[bucket];
+		if(!p)
+			continue;
+
+		//detach the bucket, then relink its procs in order. A proc can land in a bucket still to
+		//come, and is relinked there again, which keeps the order of equal keys.
+		Proc *end = p->pqbucket.prev;
+		first[bucket] = null;
+		for(;;) {
+			Proc *next = p->pqbucket.next;
+			link(p, bucketOf(p->pqbucket.key));
+			if(p == end)
+				break;
+			p = next;
 		}
-		deallocNode(minNode);
 	}
+}
+
+bool RadixHeap::getMinKey(long long *pkey) {
+	if(isEmpty())
+		return false;
 
+	settle();
+	*pkey = last;
+	return true;
+}
+
+Proc* RadixHeap::peek() {
+	if(isEmpty())
+		return null;
+
+	settle();
+	return first[0];
+}
+
+Proc* RadixHeap::extractMin() {
+	if(isEmpty())
+		return null;
+
+	settle();
+	Proc *p = first[0];
+	unlink(p);
+	if(!--size)
+		last = 0;
 	return p;
 }
 
-bool Map::transfer() {
-	if(!roundRobinQ->isEmpty())
+bool RadixHeap::extractProc(Proc *p) {
+	if(!p || !p->pqbucket.bucket)
 		return false;
 
-	while(!isEmpty()) {
-		Proc* p = extractMin();
-		roundRobinQ->enqueue(p); //should succeed.
+	unlink(p);
+	if(!--size)
+		last = 0;
+	return true;
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::isEmpty() {
+	return !size;
+}
+
+template<int Capacity>
+int ProcHeap<Capacity>::getSize() {
+	return size;
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::less(int i, Proc *p) {
+	SchedHeap &a = slots[i]->*hook, &b = p->*hook;
+	if(a.key != b.key)
+		return a.key < b.key;
+
+	return a.seq < b.seq;
+}
+
+template<int Capacity>
+void ProcHeap<Capacity>::place(Proc *p, int i) {
+	slots[i] = p;
+	(p->*hook).index = i + 1;
+}
+
+template<int Capacity>
+void ProcHeap<Capacity>::siftUp(int i) {
+	Proc *p = slots[i];
+	while(i > 0) {
+		int parent = (i - 1) / 2;
+		if(less(parent, p))
+			break;
+
+		place(slots[parent], i);
+		i = parent;
+	}
+	place(p, i);
+}
+
+template<int Capacity>
+void ProcHeap<Capacity>::siftDown(int i) {
+	Proc *p = slots[i];
+	for(;;) {
+		int child = 2 * i + 1;
+		if(child >= size)
+			break;
+
+		if(child + 1 < size && less(child + 1, slots[child]))
+			++child;
+
+		if(!less(child, p))
+			break;
+
+		place(slots[child], i);
+		i = child;
 	}
+	place(p, i);
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::add(Proc *p) {
+	return insert(p, getAccumulator(p));
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::insert(Proc *p, long long key) {
+	if(size == Capacity || (p->*hook).index)
+		return false;
 
+	(p->*hook).key = key;
+	(p->*hook).seq = seq++;
+	return relink(p);
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::relink(Proc *p) {
+	if(size == Capacity || (p->*hook).index)
+		return false;
+
+	place(p, size++);
+	siftUp(size - 1);
 	return true;
 }
 
-bool Map::extractProc(Proc *p) {
-	if(!freeNodes)
+template<int Capacity>
+bool ProcHeap<Capacity>::remove(Proc *p) {
+	int i = (p->*hook).index - 1;
+	if(i < 0 || i >= size || slots[i] != p)
 		return false;
 
-	bool ans = false;
-	Map tempMap;
-	while(!isEmpty()) {
-		Proc *otherP = extractMin();
-		if(otherP != p)
-			tempMap.put(otherP); //should scucceed.
-		else ans = true;
-	}
-	root = tempMap.root;
-	return ans;
+	(p->*hook).index = 0;
+	if(i == --size)
+		return true;
+
+	place(slots[size], i); //fill the hole with the last proc and restore the order around it.
+	siftUp(i);
+	siftDown((slots[i]->*hook).index - 1);
+	return true;
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::getMinKey(long long *pkey) {
+	if(isEmpty())
+		return false;
+
+	*pkey = (slots[0]->*hook).key;
+	return true;
+}
+
+template<int Capacity>
+void ProcHeap<Capacity>::rekey() {
+	for(int i = 0; i < size; ++i)
+		(slots[i]->*hook).key = getAccumulator(slots[i]);
+
+	for(int i = size / 2 - 1; i >= 0; --i) //heapify bottom up
+		siftDown(i);
+}
+
+template<int Capacity>
+Proc* ProcHeap<Capacity>::peek() {
+	return size ? slots[0] : null;
+}
+
+template<int Capacity>
+Proc* ProcHeap<Capacity>::extractMin() {
+	if(isEmpty())
+		return null;
+
+	Proc *p = slots[0];
+	remove(p);
+	return p;
+}
+
+template<int Capacity>
+bool ProcHeap<Capacity>::extractProc(Proc *p) {
+	return remove(p);
 }
 
 long long __moddi3(long long number, long long divisor) { //returns number%divisor
@@ -3,117 +3,393 @@
 extern "C" {
 	#include "types.h"
 	#include "param.h"
+	#include "mmu.h"
+	#include "proc.h"
+	#include "spinlock.h"
 	#include "schedulinginterface.h"
 	void initSchedDS();
+	void dumpSchedDS();
+	int sizeSchedDS(int cpu);
+	int balanceSchedDS();
 }
 
+//The priority queue backends, chosen at build time with PQ_BACKEND= in the Makefile.
+#define PQ_RBTREE  1 //RBTree, a red-black tree
+#define PQ_PAIRING 2 //PairingHeap
+#define PQ_BINARY  3 //BinaryHeap, a binary heap in a flat array
+#define PQ_RADIX   4 //RadixHeap, a monotone priority queue
+
+#ifndef PQ_BACKEND
+#define PQ_BACKEND PQ_RBTREE
+#endif
+
 typedef struct proc Proc;
+typedef struct schedlink SchedLink;
+typedef struct schedtree SchedTree;
+typedef struct schedpair SchedPair;
+typedef struct schedbucket SchedBucket;
+typedef struct schedheap SchedHeap;
 
-class Link;
-class MapNode;
 class LinkedList;
-class Map;
+class MultiLevelQueue;
+class RBTree;
+class PairingHeap;
+class BinaryHeap;
+class RadixHeap;
+template<typename Backend> class Map;
+class RunQueue;
+template<int Capacity> class ProcHeap;
 
-static Link* allocLink(Proc *p);
-static void deallocLink(Link *link);
-static void deallocNode(MapNode *node);
-static MapNode* allocNode(long long key);
-static MapNode* allocNode(Proc *p, long long key);
+#if PQ_BACKEND == PQ_RADIX
+typedef Map<RadixHeap> PriorityMap;
+#elif PQ_BACKEND == PQ_BINARY
+typedef Map<BinaryHeap> PriorityMap;
+#elif PQ_BACKEND == PQ_PAIRING
+typedef Map<PairingHeap> PriorityMap;
+#else
+typedef Map<RBTree> PriorityMap;
+#endif
 
-class Link {
-public:
-	Link(): p(null), next(null) {}
-	~Link() {}
-
-private:
-	//MARK: make some friends
-	friend void initSchedDS();
-	friend Link* allocLink(Proc *p);
-	friend void deallocLink(Link *link);
-	friend LinkedList;
-	
-	//MARK: private methods
-	Link* getLast(); //returns the last link in this list
+//The real-time queue is keyed by deadline. Deadlines don't only grow like accumulators, which the
+//radix heap relies on, so it is a tree whatever the backend.
+typedef Map<RBTree> DeadlineMap;
 
-	//MARK: fields
-	Proc *p;
-	Link *next;
-};
+//All the structures are intrusive: they link the procs through the hooks embedded in struct proc
+//(see proc.h). Nothing is allocated per process, so none of the operations below can fail.
 
 class LinkedList {
 public:
-	LinkedList(): first(null), last(null) {} 
+	LinkedList(): first(null), last(null), size(0), hook(&Proc::rqlink) {} 
+	LinkedList(SchedLink Proc::*hook): first(null), last(null), size(0), hook(hook) {} 
 	~LinkedList() {} 
 
 	bool isEmpty(); //checks whether this linked list is empty
 
-	bool enqueue(Proc* p); //append the given proc to the end of the list. Allocates a link node. Returns false if the allocation falied.
-	Proc* dequeue(); //removes and returns the first proc of this linked list. Deallocates a link node. Returns null if this list is empty(). 
+	bool enqueue(Proc* p); //append the given proc to the end of the list. Always succeeds.
+	Proc* dequeue(); //removes and returns the first proc of this linked list. Returns null if this list is empty(). 
+	Proc* peek(); //returns the first proc without removing it. Returns null if this list is empty().
 	
-	bool remove(Proc *p); //remove a specific proc from this list. Returns true iff succeeds.
+	bool remove(Proc *p); //remove a specific proc from this list in O(1). Returns true iff p was in this list.
+	int getSize(); //the number of procs in this list.
+
+	template<typename Func>
+	int moveIf(LinkedList *target, const Func& take) { //moves the procs take() accepts to the end of target, in order. Returns how many.
+		int moved = 0;
+		forEach([&](Proc *p) {
+			if(take(p)) {
+				remove(p);
+				target->enqueue(p);
+				++moved;
+			}
+		});
+		return moved;
+	}
+
+	void append(LinkedList *other); //moves all the procs of other, which links through the same hook, to the end of this list in O(1).
 
-	bool transfer(); //transfers all the procs to the Priority Queue. Fails if allocations failed. Deallocates link nodes.
+	bool transfer(PriorityMap *target); //transfers all the procs to the given Priority Queue. Fails if it isn't empty.
 	bool getMinKey(long long *pkey); //stores the minimum key in the pkey arg. Returns true iff this list isn't empty.
 
 private:
+	//MARK: make some friends
+	template<typename Backend> friend class Map;
+
 	//MARK: private methods
-	void append(Link *link); //appends the given list to the queue. No allocations always succeeds.
-	
+	bool contains(Proc *p); //checks whether p is linked in this list. O(1).
+
 	template<typename Func>
-	void forEach(const Func& accept) { //for-each loop. gets a function that applies the procin each link node.
-		Link *link = first;
-		while(link) {
-			accept(link->p);
-			link = link->next;
+	void forEach(const Func& accept) { //for-each loop. gets a function that applies the proc in each link.
+		Proc *p = first;
+		while(p) {
+			Proc *next = (p->*hook).next;
+			accept(p);
+			p = next;
 		}
 	}
 
 	//MARK: fields
-	Link *first, *last;
+	Proc *first, *last;
+	int size;
+	SchedLink Proc::*hook; //the hook of struct proc this list links through
 };
 
-class MapNode {
+//RBTree is a red-black tree keyed by accumulator, so insert() and extractMin() are O(log n)
+//even though accumulators only grow and keys arrive in near-sorted order. The left most node
+//is cached, so getMinKey() and peek() are O(1). Map also keeps its procs by last_tq in one,
+//linked through another hook.
+class RBTree {
 public:
-	MapNode(): listOfProcs(), next(null), parent(null), left(null), right(null) {}
-	~MapNode() {}
+	RBTree(): root(null), leftmost(null), seq(0), size(0), hook(&Proc::pqtree) {}
+	RBTree(SchedTree Proc::*hook): root(null), leftmost(null), seq(0), size(0), hook(hook) {}
+	~RBTree() {}
 
-	bool isEmpty(); //checks whether this->listOfProcs is empty
-	bool put(Proc *p); //puts the give proc in the rooted tree. Allocates a map node if needed. Allocates a link node. Returns true iff succeeds.
-	MapNode* getMinNode(); //returns the left most node of this rooted tree.
-	void getMinKey(long long *pkey); //stores the minmum key of this rooted tree in the pkey arg.
-	Proc* dequeue(); //removes and returns the first proc of this->listOfProcs. Deallocates a link node. Returns null if this->listOfProcs is empty(). 
+	bool isEmpty(); //checks whether this tree is empty
+	bool insert(Proc *p, long long key); //links p into the tree under the given key. Always succeeds.
+	bool relink(Proc *p); //links an extracted p back under its key and insert order, so it keeps its place among equal keys. Always succeeds.
+	bool getMinKey(long long *pkey); //stores the minmum key of this rooted tree in the pkey arg. Returns true iff this tree isn't empty.
+	Proc* peek(); //returns the proc extractMin() would, without removing it. O(1).
+	Proc* extractMin(); //removes and returns a minimum proc from this tree. Returns null if this tree is empty().
+	bool extractProc(Proc *p); //remove a specific proc from this tree in O(log n). Returns true iff p was in this tree.
+	int getSize(); //the number of procs in this tree.
+	bool build(LinkedList *source, long long key); //links all the procs of source under the given key, in their order, as a balanced tree in O(n). Fails if this tree isn't empty.
+	void flatten(LinkedList *target); //moves all the procs to the end of target, smallest first, in O(n).
+	Proc* next(Proc *p); //returns the proc after p in order, or null. O(log n), amortized O(1) over a walk from peek().
+	bool verify(); //checks the red-black properties, the links, the order, the height bound and the leftmost cache. O(n log n), for the host tests.
 
 private:
-	//MARK: make some friends
-	friend void initSchedDS();
-	friend void deallocNode(MapNode *node);
-	friend MapNode* allocNode(long long key);
-	friend MapNode* allocNode(Proc *p, long long key);
-	friend LinkedList;
-	friend Map;
+	//MARK: private methods
+	bool contains(Proc *p); //checks whether p is linked in this tree. O(1).
+	bool less(Proc *a, Proc *b); //orders by key, then by insert order.
+	Proc* getMinNode(Proc *node); //returns the left most node of the tree rooted at node.
+	bool isRed(Proc *node); //null children count as black.
+	void rotateLeft(Proc *node); //node's right child takes its place.
+	void rotateRight(Proc *node); //node's left child takes its place.
+	void insertFixup(Proc *node); //restores the red-black properties after linking the red leaf node.
+	void removeNode(Proc *node); //unlinks node from the tree and rebalances.
+	void removeFixup(Proc *node, Proc *parent); //restores the red-black properties after removing a black node. node may be null.
 
 	//MARK: fields
-	long long key;
-	LinkedList listOfProcs;
-	MapNode *next, *parent, *left, *right;
+	Proc *root;
+	Proc *leftmost; //the min node, or null when the tree is empty
+	long long seq; //insert counter, keeps procs with equal keys in FIFO order
+	int size;
+	SchedTree Proc::*hook; //the hook of struct proc this tree links through
 };
 
+//Map is the priority queue of a run queue. The structure itself is a backend, and each backend
+//has the same public interface: isEmpty(), getSize(), insert(p, key), getMinKey(), peek(),
+//extractMin() and extractProc(). Backends order procs by key, and procs with equal keys by their insert order.
+//The policy switches move every proc at once, through fill() and drain() (see ass1ds.cpp), which
+//a backend may beat the one by one default of. RBTree does both in O(n).
+//The procs are also kept by last_tq, the order they last ran in, in a second tree for SP_eps's aging
+//pick. A woken proc can be put anywhere in that order, and the tree places it in O(log n), so the
+//pick only reads the leftmost node. last_tq only changes while a proc runs, never while it is queued.
+template<typename Backend>
 class Map {
 public:
-	Map(): root(null) {}
+	Map(): backend(), aging(&Proc::agetree) {}
 	~Map() {}
 
 	bool isEmpty(); //checks whether this map is empty
-	bool put(Proc *p); //puts the give proc in this->root node. Allocates a map node if needed. Allocates a link node. Returns true iff succeeds.
-	bool getMinKey(long long *pkey); //stores the minmum key of this rooted tree in the pkey arg. Returns true iff this map isn't empty.
-	Proc* extractMin(); //removes and returns a minimum proc from this map. Deallocates a map node if needed. Deallocates a link node. Returns null if this map is empty().
-	bool transfer(); //transfers all the procs to the Round Robin Queue. Fails if allocations failed. Deallocates map nodes. Deallocates link nodes.
-	bool extractProc(Proc *p); //remove a specific proc from this map. Returns true iff succeeds.
+	bool put(Proc *p); //puts the give proc in this map, keyed by its accumulator.
+	bool put(Proc *p, long long key); //puts the give proc in this map under the given key.
+	bool getMinKey(long long *pkey); //stores the minmum key of this map in the pkey arg. Returns true iff this map isn't empty.
+	Proc* peek(); //returns the proc extractMin() would, without removing it. Returns null if this map is empty().
+	Proc* extractMin(); //removes and returns a minimum proc from this map. Returns null if this map is empty().
+	Proc* next(Proc *p); //returns the proc after p in extractMin() order, or null. Only the tree backend walks, so only a DeadlineMap has it.
+	Proc* peekLeastRecent(); //returns the proc that ran least recently in O(1). Returns null if this map is empty().
+	bool transfer(LinkedList *target); //transfers all the procs to the given Round Robin Queue. Fails if it isn't empty.
+	bool extractProc(Proc *p); //remove a specific proc from this map. Returns true iff p was in this map.
+	int getSize(); //the number of procs in this map.
+
+	template<typename Func>
+	int moveIf(Map *target, const Func& take) { //moves the procs take() accepts among the BALANCE_SCAN first ones to target, keeping their keys. The others keep their places. Returns how many.
+		Proc *kept[BALANCE_SCAN];
+		int moved = 0, nkept = 0;
+		for(int i = 0; i < BALANCE_SCAN; ++i) {
+			long long key;
+			if(!getMinKey(&key))
+				break;
+			Proc *p = extractMin();
+			if(take(p)) {
+				target->insert(p, key);
+				++moved;
+			} else
+				kept[nkept++] = p;
+		}
+		while(nkept--) //in reverse, see RadixHeap::relink().
+			relink(kept[nkept]);
+		return moved;
+	}
 
 private:
 	//MARK: make some friends
 	friend LinkedList;
 
+	//MARK: private methods
+	bool insert(Proc *p, long long key); //puts p in this map under the given key.
+	bool relink(Proc *p); //puts an extracted p back in its place, see the backends' relink().
+	bool build(LinkedList *source, long long key); //moves all the procs of source in, in their order, under the given key. O(n) plus the backend's fill. Fails if this map isn't empty.
+
 	//MARK: fields
-	MapNode *root;
+	Backend backend;
+	RBTree aging; //the procs keyed by last_tq, the least recently run first
 };
+
+//PairingHeap is a heap ordered multiway tree: each child list is linked through the siblings,
+//and the min is the root. insert() and getMinKey() are O(1), extractMin() and extractProc()
+//are amortized O(log n). The children are merged in two passes, without recursion.
+class PairingHeap {
+public:
+	PairingHeap(): root(null), seq(0), size(0) {}
+	~PairingHeap() {}
+
+	bool isEmpty(); //checks whether this heap is empty
+	bool insert(Proc *p, long long key); //melds p into the heap under the given key. Always succeeds.
+	bool relink(Proc *p); //melds an extracted p back under its key and insert order, so it keeps its place among equal keys. Always succeeds.
+	bool getMinKey(long long *pkey); //stores the minmum key of this heap in the pkey arg. Returns true iff this heap isn't empty.
+	Proc* peek(); //returns the proc extractMin() would, without removing it. O(1).
+	Proc* extractMin(); //removes and returns a minimum proc from this heap. Returns null if this heap is empty().
+	bool extractProc(Proc *p); //remove a specific proc from this heap. Returns true iff p was in this heap.
+	int getSize(); //the number of procs in this heap.
+
+private:
+	//MARK: private methods
+	bool contains(Proc *p); //checks whether p is linked in this heap. O(1).
+	static bool less(Proc *a, Proc *b); //orders by key, then by insert order.
+	static Proc* meld(Proc *a, Proc *b); //makes the bigger root the first child of the other one, and returns it.
+	static Proc* mergePairs(Proc *first); //melds a sibling list into a single tree. Returns null if it is empty.
+	void unlink(Proc *p); //cuts p and its subtree out of its parent's child list. p must not be the root.
+
+	//MARK: fields
+	Proc *root;
+	long long seq; //insert counter, keeps procs with equal keys in FIFO order
+	int size;
+};
+
+#define NBUCKETS 65 //a bucket per bit of a long long key, plus one for the minimum itself
+
+//RadixHeap is a monotone priority queue: it is fast while no key is smaller than the last
+//extracted minimum, which is how accumulators behave. Bucket 0 holds the procs whose key
+//equals that minimum, and bucket i holds those whose key first differs from it at bit i-1.
+//insert() is O(1). extractMin() is O(1) while bucket 0 has procs, and otherwise redistributes
+//the first non-empty bucket, which is amortized O(1) per proc for each of the 64 key bits.
+//The minimum starts over at 0 whenever the heap empties, e.g. in a policy switch. A key below
+//it, e.g. one from another run queue, rebases the heap on that key in O(size).
+class RadixHeap {
+public:
+	RadixHeap(): last(0), size(0) {
+		for(int i = 0; i < NBUCKETS; ++i)
+			first[i] = null;
+	}
+	~RadixHeap() {}
+
+	bool isEmpty(); //checks whether this heap is empty
+	bool insert(Proc *p, long long key); //links p into the bucket of the given key. Always succeeds.
+	bool relink(Proc *p); //links an extracted p back under its key, first among the equal keys. Relinking in reverse extract order restores the order. Always succeeds.
+	bool getMinKey(long long *pkey); //stores the minmum key of this heap in the pkey arg. Returns true iff this heap isn't empty.
+	Proc* peek(); //returns the proc extractMin() would, without removing it. Redistributes like extractMin().
+	Proc* extractMin(); //removes and returns a minimum proc from this heap. Returns null if this heap is empty().
+	bool extractProc(Proc *p); //remove a specific proc from this heap in O(1). Returns true iff p was in this heap.
+	int getSize(); //the number of procs in this heap.
+
+private:
+	//MARK: private methods
+	int bucketOf(long long key); //the bucket a key belongs to, relative to this->last.
+	void link(Proc *p, int bucket); //appends p to the given bucket. Buckets are circular lists, so first->prev is the last proc.
+	void unlink(Proc *p); //removes p from its bucket.
+	void settle(); //makes bucket 0 non-empty by redistributing the first non-empty bucket. Requires !isEmpty().
+	void rebase(long long key); //lowers this->last to the given key and relinks every proc relative to it.
+
+	//MARK: fields
+	Proc *first[NBUCKETS];
+	long long last; //the last extracted minimum
+	int size;
+};
+
+//ProcHeap is a binary min-heap of at most Capacity procs in a flat array, keyed by accumulator.
+//Procs with equal keys are ordered by their insert order.
+//Each proc remembers its slot, so it can be removed without a search.
+template<int Capacity>
+class ProcHeap {
+public:
+	ProcHeap(SchedHeap Proc::*hook): seq(0), size(0), hook(hook) {}
+	~ProcHeap() {}
+
+	bool isEmpty(); //checks whether this heap is empty
+	bool add(Proc *p); //adds the given proc, keyed by its accumulator. O(log Capacity). Returns false iff the heap is full.
+	bool remove(Proc *p); //removes a specific proc. O(log Capacity). Returns true iff p was in this heap.
+	bool getMinKey(long long *pkey); //stores the minimum key in the pkey arg in O(1). Returns true iff this heap isn't empty.
+	void rekey(); //re-keys every proc by its accumulator and restores the heap order. O(Capacity).
+
+	//the priority queue backend interface, see Map.
+	bool insert(Proc *p, long long key); //adds p under the given key. O(log Capacity). Returns false iff the heap is full.
+	bool relink(Proc *p); //adds an extracted p back under its key and insert order, so it keeps its place among equal keys. Returns false iff the heap is full.
+	Proc* peek(); //returns the proc extractMin() would, without removing it. O(1).
+	Proc* extractMin(); //removes and returns a minimum proc. O(log Capacity). Returns null if this heap is empty().
+	bool extractProc(Proc *p); //same as remove().
+	int getSize(); //the number of procs in this heap.
+
+private:
+	//MARK: private methods
+	bool less(int i, Proc *p); //checks whether the proc in slot i comes before p.
+	void place(Proc *p, int i); //stores p in slot i and updates its hook.
+	void siftUp(int i); //moves the proc in slot i up until its parent is not bigger.
+	void siftDown(int i); //moves the proc in slot i down until its children are not smaller.
+
+	//MARK: fields
+	Proc *slots[Capacity];
+	long long seq; //insert counter, keeps procs with equal keys in FIFO order
+	int size;
+	SchedHeap Proc::*hook; //the hook of struct proc this heap indexes through
+};
+
+//BinaryHeap is the flat array backend: a ProcHeap big enough for every proc.
+class BinaryHeap: public ProcHeap<NPROC> {
+public:
+	BinaryHeap(): ProcHeap<NPROC>(&Proc::pqheap) {}
+	~BinaryHeap() {}
+};
+
+//MultiLevelQueue is a LinkedList per level, level 0 first. Each proc is queued at its
+//p->level. A bitmap of the non-empty levels finds the first one with a single bsf
+//instruction, so every operation but boost() and the transfers is O(1), and those are
+//O(MLFQ_LEVELS).
+class MultiLevelQueue {
+public:
+	MultiLevelQueue(): bitmap(0), size(0) {}
+	~MultiLevelQueue() {}
+
+	bool isEmpty(); //checks whether this queue is empty
+	bool enqueue(Proc *p); //appends p to the list of its level. Always succeeds.
+	Proc* dequeue(); //removes and returns the first proc of the highest non-empty level. Returns null if this queue is empty().
+	Proc* peek(); //returns the proc dequeue() would, without removing it.
+	int getSize(); //the number of procs in this queue.
+	bool boost(); //moves the procs of every level to level 0, keeping their order. Their level fields are the caller's.
+	bool transfer(LinkedList *target); //transfers all the procs to the given Round Robin Queue, level 0 first. Fails if it isn't empty.
+	bool takeFrom(LinkedList *source); //transfers all the procs of the given Round Robin Queue to level 0. Fails if this queue isn't empty.
+
+	template<typename Func>
+	int moveIf(MultiLevelQueue *target, const Func& take) { //moves the procs take() accepts to the same levels of target, lowest level first. Returns how many.
+		int moved = 0;
+		for(int level = MLFQ_LEVELS - 1; level >= 0; --level) {
+			int n = levels[level].moveIf(&target->levels[level], take);
+			if(!n)
+				continue;
+			if(levels[level].isEmpty())
+				bitmap &= ~(1u << level);
+			target->bitmap |= 1u << level;
+			moved += n;
+		}
+		size -= moved;
+		target->size += moved;
+		return moved;
+	}
+
+private:
+	//MARK: fields
+	LinkedList levels[MLFQ_LEVELS]; //all link through p->rqlink, like the Round Robin Queue
+	uint bitmap; //bit i is set iff levels[i] isn't empty
+	int size;
+};
+
+#define CACHELINE 64
+
+//RunQueue holds the RUNNABLE procs of a single cpu, one structure per policy family.
+//It is aligned to a cache line, so cpus working on their own queues don't share lines.
+//The structures are guarded by this->lock rather than by ptable.lock. When both are
+//needed, ptable.lock is taken first.
+class RunQueue {
+public:
+	RunQueue(int cpu): cpu(cpu), load(0), runnable(), roundRobinQ(&Proc::rqlink), priorityQ() {}
+	~RunQueue() {}
+
+	int cpu; //the cpu owning this queue
+	int load; //the summed rqweight of the queued procs
+	int runnable[NCPU]; //per cpu, the queued procs whose rqaffinity holds it
+	struct spinlock lock;
+	LinkedList roundRobinQ;
+	PriorityMap priorityQ;
+	MultiLevelQueue multiLevelQ;
+} __attribute__((aligned(CACHELINE)));
+
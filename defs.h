@@ -10,6 +10,13 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct perf;
+struct procinfo;
+
+// ass1ds.cpp
+void            initSchedDS(void);
+void            dumpSchedDS(void);
+int             sizeSchedDS(int);
+int             balanceSchedDS(void);
 
 // bio.c
 void            binit(void);
@@ -79,6 +86,8 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
+unsigned long long tsc2ns(unsigned long long);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -113,6 +122,7 @@ struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
+int             reschedule(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
@@ -121,10 +131,21 @@ void            userinit(void);
 int             wait(int*);
 void            wakeup(void*);
 void            yield(void);
+void            expire(void);
 int 			detach(int);
 void 			priority(int);  
 void 			policy(int); 
 int 			wait_stat(int* , struct perf*);
+int 			quantum(int);
+int 			tickets(int);
+int 			setaffinity(int, uint);
+int 			realtime(int, int);
+void 			rttick(void);
+void 			balance(void);
+int 			migrations(int*);
+int 			getprocinfo(struct procinfo*, int);
+int 			rtcharge(void);
+void 			throttle(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -134,6 +155,7 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            lockdump(struct spinlock*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -195,20 +217,24 @@ void            clearpteu(pde_t *pgdir, char *uva);
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
 
 //Added by Dan & Ido:
-void 			swtch_to_proc(struct proc*, struct cpu*);
+int 			swtch_to_proc(struct proc*, struct cpu*);
 long long 		get_min_acc(void); 
 long long		min(long long, long long) ;
 
 void 			enqueue_by_state(struct proc*);
 
-struct proc* 	proc_to_run(void); 
-struct proc*	proc_with_min_timestamp(void);
+struct proc* 	proc_to_run(struct cpu*); 
 
-void 			sp_round_robin (struct cpu*);
-void 			sp_priority (struct cpu*);
-void 			sp_ext_priority (struct cpu*);
+int 			sp_round_robin (struct cpu*);
+int 			sp_priority (struct cpu*);
+int 			sp_ext_priority (struct cpu*);
+int 			sp_cfs (struct cpu*);
+int 			sp_mlfq (struct cpu*);
+int 			sp_stride (struct cpu*);
+int 			sliceover(void);
 
 void 			set_all_accumulators(int);
+void 			reset_sched_keys(void);
 void 			set_filtered_priorities(int,int);
 
 void 			update_pref_field(int, int,  struct proc*);
\ No newline at end of file
@@ -0,0 +1,180 @@
+//Host micro-benchmarks of the scheduler data structures, built by "make ds-bench".
+//ass1ds.cpp is compiled unchanged for the host and linked against the kernel shims in
+//dsshims.cpp. There is a single cpu, so every operation works on one run queue, and the
+//locks are no-ops.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ass1ds.hpp"
+
+extern "C" {
+	extern PriorityQueue          pq;
+	extern RoundRobinQueue        rrq;
+	extern RunningProcessesHolder rpholder;
+}
+
+//MARK: measuring
+static double now() { //in ns
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double started;
+
+static void start() {
+	started = now();
+}
+
+static void stop(const char *name, long ops) { //prints ns per op since start().
+	double ns = (now() - started) / ops;
+	printf("  %-32s %9.1f ns/op\n", name, ns);
+#ifdef LOCKSTAT
+	dumpSchedDS(); //the lock holds of the operations above, see dsshims.cpp
+#endif
+}
+
+static bool putAll(Proc *procs, int n) { //puts the procs in order. Fails if the backend fills up.
+	for(int i = 0; i < n; ++i) {
+		if(!pq.put(&procs[i])) {
+			while(pq.extractMin());
+			return false;
+		}
+	}
+	return true;
+}
+
+static void bench(int n) {
+	Proc *procs = (Proc*)calloc(n, sizeof(Proc));
+	int *order = (int*)malloc(n * sizeof(int));
+	int rounds = n < (1 << 20) ? (1 << 20) / n : 1; //about a million operations per measurement
+
+	for(int i = 0; i < n; ++i) {
+		procs[i].priority = i % NP_PRIORITY + 1;
+		procs[i].affinity = AFFINITY_ALL;
+		procs[i].last_cpu = -1;
+		order[i] = i;
+	}
+
+	srand(n);
+	for(int i = n - 1; i > 0; --i) { //a random order for extractProc
+		int j = rand() % (i + 1);
+		int tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for(int i = 0; i < n; ++i) //as if they last ran in that order, so they are put out of last_tq order.
+		procs[order[i]].last_tq = i;
+
+	printf("%d procs:\n", n);
+
+	if(!putAll(procs, n)) {
+		printf("  skipped, the priority queue backend holds at most %d procs\n", NPROC);
+		free(order);
+		free(procs);
+		return;
+	}
+	while(pq.extractMin());
+
+	double putNs = 0, extractNs = 0;
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		double t = now();
+		putAll(procs, n);
+		putNs += now() - t;
+		t = now();
+		while(pq.extractMin());
+		extractNs += now() - t;
+	}
+	printf("  %-32s %9.1f ns/op\n", "pq.put", putNs / ((long)rounds * n));
+	printf("  %-32s %9.1f ns/op\n", "pq.extractMin", extractNs / ((long)rounds * n));
+	stop("pq.put + pq.extractMin", 2L * rounds * n);
+
+	putAll(procs, n);
+	start();
+	for(long k = 0; k < (long)rounds * n; ++k) { //what the priority policies do every quantum
+		Proc *p = pq.extractMin();
+		p->accumulator += p->priority;
+		pq.put(p);
+	}
+	stop("pq.extractMin, then put", (long)rounds * n);
+
+	long long minAcc;
+	start();
+	for(long k = 0; k < (long)rounds * n; ++k) { //what get_min_acc() does on every fork and wakeup
+		Proc *p = pq.extractMin();
+		pq.put(p);
+		pq.getMinAccumulator(&minAcc);
+	}
+	stop("extractMin, put, getMinAccumulator", (long)rounds * n);
+	while(pq.extractMin());
+
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		putAll(procs, n);
+		for(int i = 0; i < n; ++i)
+			pq.extractProc(&procs[order[i]]);
+	}
+	stop("pq.put + pq.extractProc", 2L * rounds * n);
+
+	start();
+	for(int r = 0; r < rounds; ++r) { //SP_eps's aging pick. The procs are put out of last_tq order, like wakeups.
+		putAll(procs, n);
+		while(pq.extractLeastRecent());
+	}
+	stop("pq.put + pq.extractLeastRecent", 2L * rounds * n);
+
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		for(int i = 0; i < n; ++i)
+			rrq.enqueue(&procs[i]);
+		while(rrq.dequeue());
+	}
+	stop("rrq.enqueue + rrq.dequeue", 2L * rounds * n);
+
+	LinkedList list(&Proc::rqlink);
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		for(int i = 0; i < n; ++i)
+			list.enqueue(&procs[i]);
+		for(int i = 0; i < n; ++i)
+			list.remove(&procs[order[i]]);
+	}
+	stop("enqueue + LinkedList::remove", 2L * rounds * n);
+
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		for(int i = 0; i < n; ++i)
+			rrq.enqueue(&procs[i]);
+		rrq.switchToPriorityQueuePolicy();
+		pq.switchToRoundRobinPolicy();
+		while(rrq.dequeue());
+	}
+	stop("both switch transfers, per proc", (long)rounds * n);
+
+	int running = n < NCPU ? n : NCPU;
+	start();
+	for(int r = 0; r < rounds; ++r) {
+		for(int i = 0; i < running; ++i)
+			rpholder.add(&procs[order[i]]);
+		for(int i = 0; i < running; ++i)
+			rpholder.remove(&procs[order[i]]);
+	}
+	stop("rpholder.add + remove", 2L * rounds * running);
+
+	free(order);
+	free(procs);
+}
+
+int main(int argc, char *argv[]) {
+	initSchedDS();
+	printf("scheduler data structures, backend %d (see ass1ds.hpp)\n", PQ_BACKEND);
+
+	for(int n = 64; n <= 65536; n *= 4)
+		bench(n);
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+//Kernel shims for the host builds of ass1ds.cpp: dsbench and dstest, see the Makefile.
+//They stand in for the kernel functions ass1ds.cpp calls. The locks are no-ops, unless built
+//with LOCKSTAT, which times them, and cpuid() is whatever cpu the program sets in dscpu.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "ass1ds.hpp"
+
+extern "C" {
+	int ncpu = 1;
+	int dscpu;    //the cpu cpuid() returns
+	void panic(char *s) {
+		fprintf(stderr, "panic: %s\n", s);
+		exit(1);
+	}
+
+	long long getAccumulator(Proc *p) {
+		return p->accumulator;
+	}
+
+	int getWeight(Proc *p) {
+		return 1024;
+	}
+
+	int cpuid() {
+		return dscpu;
+	}
+
+	void pushcli() {}
+	void popcli() {}
+#ifdef LOCKSTAT
+	//Times the holds like spinlock.c does, and lockdump() prints and restarts them.
+	void acquire(struct spinlock *lk) {
+		lk->tsc = __rdtsc();
+	}
+
+	void release(struct spinlock *lk) {
+		lk->cycles += __rdtsc() - lk->tsc;
+		lk->nacquire++;
+	}
+
+	void initlock(struct spinlock *lk, char *name) {
+		memset(lk, 0, sizeof(*lk));
+		lk->name = name;
+	}
+
+	void lockdump(struct spinlock *lk) {
+		if(lk->nacquire)
+			printf("  %-32s %9.1f cycles held, %u acquires\n", lk->name,
+				(double)lk->cycles / lk->nacquire, lk->nacquire);
+		lk->nacquire = 0;
+		lk->cycles = 0;
+	}
+#else
+	void acquire(struct spinlock*) {}
+	void release(struct spinlock*) {}
+	void initlock(struct spinlock*, char*) {}
+	void lockdump(struct spinlock*) {}
+#endif
+	void cprintf(char*, ...) {}
+}
@@ -0,0 +1,320 @@
+//Host tests of the scheduler data structures, built for every backend by "make ds-test".
+//Like dsbench, ass1ds.cpp is compiled unchanged for the host and linked against the kernel
+//shims in dsshims.cpp. Each test drives the queues the way proc.c does and checks the picks.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass1ds.hpp"
+
+extern "C" {
+	extern PriorityQueue          pq;
+	extern RoundRobinQueue        rrq;
+	extern RealTimeQueue          rtq;
+
+	extern int                    ncpu;
+	extern int                    dscpu; //see dsshims.cpp
+}
+
+static int failures;
+
+static void check(bool ok, const char *test, const char *what) {
+	if(ok)
+		return;
+
+	printf("  %s: %s\n", test, what);
+	++failures;
+}
+
+static void initProcs(Proc *procs, int n) {
+	memset(procs, 0, n * sizeof(Proc));
+	for(int i = 0; i < n; ++i) {
+		procs[i].pid = i + 1;
+		procs[i].priority = i + 1;
+		procs[i].affinity = AFFINITY_ALL;
+		procs[i].last_cpu = -1;
+	}
+}
+
+//Picks like the priority policies do every quantum, and counts the picks of each proc.
+static void pick(Proc *procs, int picks, int *counts) {
+	for(int k = 0; k < picks; ++k) {
+		Proc *p = pq.extractMin();
+		if(!p)
+			return;
+		++counts[p - procs];
+		p->accumulator += p->priority;
+		pq.put(p);
+	}
+}
+
+#define SHARE_PROCS 4
+#define SHARE_PICKS 1000
+
+//Each proc gets picks in inverse proportion to its priority, 480/240/160/120 of 1000.
+static void checkShares(Proc *procs, const char *test) {
+	int counts[SHARE_PROCS] = {0};
+	int sum = 0;
+	for(int i = 0; i < SHARE_PROCS; ++i)
+		sum += SHARE_PICKS / procs[i].priority;
+
+	pick(procs, SHARE_PICKS, counts);
+	for(int i = 0; i < SHARE_PROCS; ++i) {
+		int expected = SHARE_PICKS * (SHARE_PICKS / procs[i].priority) / sum;
+		if(counts[i] < expected - 2 || counts[i] > expected + 2) {
+			printf("  %s: priority %d got %d picks, not %d\n", test, procs[i].priority, counts[i],
+				expected);
+			++failures;
+		}
+	}
+}
+
+//ps, then rrs, then ps again, each switch resetting the accumulators like policy() does.
+static void testPolicySwitch() {
+	Proc procs[SHARE_PROCS];
+	initProcs(procs, SHARE_PROCS);
+	for(int i = 0; i < SHARE_PROCS; ++i)
+		pq.put(&procs[i]);
+	checkShares(procs, "ps");
+
+	for(int i = 0; i < SHARE_PROCS; ++i)
+		procs[i].accumulator = RRS_ACC_VAL;
+	pq.switchToRoundRobinPolicy();
+	for(int round = 0; round < 3; ++round) { //every proc once a round
+		int seen = 0;
+		for(int k = 0; k < SHARE_PROCS; ++k) {
+			Proc *p = rrq.dequeue();
+			if(p) {
+				seen |= 1 << (p - procs);
+				rrq.enqueue(p);
+			}
+		}
+		check(seen == (1 << SHARE_PROCS) - 1, "rrs", "not picked in turn");
+	}
+
+	for(int i = 0; i < SHARE_PROCS; ++i)
+		procs[i].accumulator = 0;
+	rrq.switchToPriorityQueuePolicy();
+	long long minAcc = -1;
+	check(pq.getMinAccumulator(&minAcc) && minAcc == 0, "rrs to ps", "the minimum accumulator isn't 0");
+	checkShares(procs, "rrs to ps");
+
+	while(pq.extractMin());
+}
+
+//A proc keyed below the minimum picked so far, like one stolen from a run queue that is behind,
+//must be picked first.
+static void testLowerKey() {
+	Proc procs[SHARE_PROCS];
+	initProcs(procs, SHARE_PROCS);
+	for(int i = 0; i < SHARE_PROCS - 1; ++i)
+		pq.put(&procs[i]);
+	int counts[SHARE_PROCS] = {0};
+	pick(procs, SHARE_PICKS, counts);
+
+	Proc *late = &procs[SHARE_PROCS - 1];
+	late->accumulator = 1;
+	pq.put(late);
+	long long minAcc = -1;
+	check(pq.getMinAccumulator(&minAcc) && minAcc == 1, "lower key", "the minimum accumulator isn't 1");
+	check(pq.extractMin() == late, "lower key", "not picked first");
+
+	Proc *p, *prev = null;
+	while((p = pq.extractMin())) { //and the rest still come out in order
+		check(!prev || prev->accumulator <= p->accumulator, "lower key", "out of order");
+		prev = p;
+	}
+}
+
+#define TREE_PROCS 1000
+
+static Proc treeProcs[TREE_PROCS];
+
+static void checkTree(RBTree *tree, const char *what) {
+	if(!tree->verify()) {
+		printf("  rbtree: broken after %s\n", what);
+		++failures;
+	}
+}
+
+//Accumulators only grow, so the tree mostly gets keys in order, which is what unbalances a
+//plain binary search tree. The red-black properties must hold after every operation, whatever
+//PQ_BACKEND is, since the real-time queue is a tree on every backend.
+static void testRBTree() {
+	RBTree tree;
+	initProcs(treeProcs, TREE_PROCS);
+	for(int i = 0; i < TREE_PROCS; ++i) {
+		tree.insert(&treeProcs[i], i);
+		checkTree(&tree, "a monotonic insert");
+	}
+
+	for(int i = 0; i < TREE_PROCS / 2; ++i) { //the scheduler's loop: the min runs, and comes back bigger
+		Proc *p = tree.extractMin();
+		tree.insert(p, TREE_PROCS + i / 4); //equal keys too
+		checkTree(&tree, "an extractMin and insert");
+	}
+
+	for(int i = 0; i < TREE_PROCS; i += 3) {
+		tree.extractProc(&treeProcs[i]);
+		checkTree(&tree, "an extractProc");
+	}
+
+	Proc *p, *prev = null;
+	while((p = tree.extractMin())) {
+		if(prev && (prev->pqtree.key > p->pqtree.key ||
+				(prev->pqtree.key == p->pqtree.key && prev->pqtree.seq > p->pqtree.seq))) {
+			check(false, "rbtree", "extracted out of order");
+			break;
+		}
+		prev = p;
+	}
+	checkTree(&tree, "draining it");
+}
+
+#define AGING_PROCS 50
+
+static void checkLeastRecent(const char *test) { //takes every proc, which must come in last_tq order.
+	for(int i = 0; i < AGING_PROCS; ++i) {
+		Proc *p = pq.extractLeastRecent();
+		if(!p || p->last_tq != i) {
+			check(false, test, "not picked in last_tq order");
+			break;
+		}
+	}
+	while(pq.extractMin());
+}
+
+//SP_eps's aging pick takes the procs by the order they last ran in, whatever order they were
+//queued in: put one by one, or all at once by the switch from round robin.
+static void testAging() {
+	Proc procs[AGING_PROCS];
+	initProcs(procs, AGING_PROCS);
+	for(int i = 0; i < AGING_PROCS; ++i) {
+		procs[i].priority = 1;
+		procs[i].last_tq = (i * 7) % AGING_PROCS; //7 is prime to AGING_PROCS, so every last_tq once
+		pq.put(&procs[i]);
+	}
+	checkLeastRecent("aging, put");
+
+	for(int i = 0; i < AGING_PROCS; ++i)
+		rrq.enqueue(&procs[i]);
+	rrq.switchToPriorityQueuePolicy();
+	checkLeastRecent("aging, switch");
+}
+
+//Two cpus share the real-time queue. Each takes the earliest deadline it may run, and a cpu
+//with only other cpus' procs queued sees the queue as empty, so it can halt.
+static void testRealTimeAffinity() {
+	Proc procs[4];
+	initProcs(procs, 4);
+	procs[0].deadline = 10; //pinned to cpu 1
+	procs[0].affinity = 1 << 1;
+	procs[1].deadline = 20;
+	procs[2].deadline = 5; //pinned to cpu 1
+	procs[2].affinity = 1 << 1;
+	procs[3].deadline = 30;
+
+	ncpu = 2;
+	for(int i = 0; i < 4; ++i)
+		rtq.put(&procs[i]);
+
+	dscpu = 0;
+	check(!rtq.isEmpty(), "rt affinity", "cpu 0 sees nothing to run");
+	check(rtq.extractMin() == &procs[1], "rt affinity", "cpu 0 didn't get the earliest deadline it may run");
+	dscpu = 1;
+	check(rtq.extractMin() == &procs[2], "rt affinity", "cpu 1 didn't get the earliest deadline");
+	dscpu = 0;
+	check(rtq.extractMin() == &procs[3], "rt affinity", "cpu 0 didn't get the free proc");
+	check(rtq.isEmpty(), "rt affinity", "cpu 0 sees a proc pinned to cpu 1");
+	check(rtq.extractMin() == null, "rt affinity", "cpu 0 got a proc pinned to cpu 1");
+	dscpu = 1;
+	check(!rtq.isEmpty(), "rt affinity", "cpu 1 sees nothing to run");
+	check(rtq.extractMin() == &procs[0], "rt affinity", "cpu 1 lost its proc");
+	check(rtq.isEmpty(), "rt affinity", "the queue isn't empty");
+
+	rtq.put(&procs[0]);
+	check(rtq.extractProc(&procs[0]) && rtq.isEmpty(), "rt affinity", "extractProc left a count");
+
+	for(int i = 0; i < 3; ++i) //equal deadlines run in put order, even when another cpu skips over them.
+		procs[i].deadline = 40;
+	procs[1].affinity = AFFINITY_ALL;
+	for(int i = 0; i < 3; ++i)
+		rtq.put(&procs[i]);
+	dscpu = 0;
+	check(rtq.extractMin() == &procs[1], "rt affinity", "cpu 0 didn't get the free proc");
+	dscpu = 1;
+	check(rtq.extractMin() == &procs[0], "rt affinity", "the skipped proc lost its place among equal deadlines");
+	check(rtq.extractMin() == &procs[2], "rt affinity", "cpu 1 lost its proc");
+
+	dscpu = 0;
+	ncpu = 1;
+}
+
+//A cpu whose peers only queue procs pinned away from it must see nothing to run, or it never halts.
+static void testRunQueueAffinity() {
+	Proc procs[2];
+	initProcs(procs, 2);
+	procs[0].affinity = 1 << 1;
+	procs[1].affinity = 1 << 1;
+
+	ncpu = 2;
+	rrq.enqueue(&procs[0]);
+	pq.put(&procs[1]);
+
+	dscpu = 0;
+	check(rrq.isEmpty() && pq.isEmpty(), "rq affinity", "cpu 0 sees a proc pinned to cpu 1");
+	check(rrq.dequeue() == null && pq.extractMin() == null, "rq affinity", "cpu 0 got a proc pinned to cpu 1");
+	dscpu = 1;
+	check(!rrq.isEmpty() && !pq.isEmpty(), "rq affinity", "cpu 1 sees nothing to run");
+	check(rrq.dequeue() == &procs[0] && pq.extractMin() == &procs[1], "rq affinity", "cpu 1 lost its procs");
+	check(rrq.isEmpty() && pq.isEmpty(), "rq affinity", "the queues aren't empty");
+
+	procs[0].affinity = AFFINITY_ALL;
+	pq.put(&procs[0]);
+	procs[0].affinity = 1 << 1; //setaffinity() while queued: the counts keep the mask it was queued with.
+	check(pq.extractProc(&procs[0]) && pq.isEmpty(), "rq affinity", "extractProc left a count");
+	dscpu = 0;
+	check(pq.isEmpty(), "rq affinity", "extractProc left a count on another cpu");
+
+	ncpu = 1;
+}
+
+//The balancer moves procs out of the head of a priority queue; the ones it leaves keep their FIFO places.
+#define MOVE_PROCS (BALANCE_SCAN + 4)
+static void testBalanceOrder() {
+	Proc procs[MOVE_PROCS];
+	initProcs(procs, MOVE_PROCS);
+	for(int i = 0; i < MOVE_PROCS; ++i) //equal keys, only procs 1 and 3 may leave cpu 0.
+		procs[i].affinity = i == 1 || i == 3 ? AFFINITY_ALL : 1 << 0;
+
+	ncpu = 2;
+	for(int i = 0; i < MOVE_PROCS; ++i)
+		pq.put(&procs[i]);
+	check(balanceSchedDS() == 2, "balance", "the balancer didn't move the free procs");
+
+	for(int i = 0; i < MOVE_PROCS; ++i)
+		if(i != 1 && i != 3)
+			check(pq.extractMin() == &procs[i], "balance", "the procs left behind lost their FIFO order");
+	dscpu = 1;
+	check(pq.extractMin() == &procs[1] && pq.extractMin() == &procs[3], "balance", "the moved procs lost their order");
+	check(pq.isEmpty(), "balance", "the queues aren't empty");
+
+	dscpu = 0;
+	ncpu = 1;
+}
+
+int main(int argc, char *argv[]) {
+	initSchedDS();
+
+	testRBTree();
+	testPolicySwitch();
+	testLowerKey();
+	testAging();
+	testRealTimeAffinity();
+	testRunQueueAffinity();
+	testBalanceOrder();
+
+	printf("dstest, backend %d (see ass1ds.hpp): %s\n", PQ_BACKEND, failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -43,6 +43,11 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+// tsc2ns() multiplier: ns per TSC cycle, shifted left by 20.
+// Set by tsccalibrate(); until then, assume 1 GHz.
+static uint tscmult = 1 << 20;
+static int tsccalibrated;
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,6 +56,42 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+#define CALCOUNTS 1000000  // timer counts to measure the TSC over
+
+// Measure the TSC against the timer, which lapicinit just started.
+// The timer counts down at the bus frequency, which xv6 takes to be
+// 1 GHz (10000000 counts are its 10ms tick), so a count is a ns.
+// The TSC runs at the same rate on every cpu, so the boot cpu
+// calibrates once for all.
+static void
+tsccalibrate(void)
+{
+  uint start, now, perus;
+  unsigned long long tsc;
+
+  while(lapic[TCCR] < 2*CALCOUNTS)  // not too close to the reload
+    ;
+  start = lapic[TCCR];
+  tsc = rdtsc();
+  do
+    now = lapic[TCCR];
+  while(start - now < CALCOUNTS);
+  // Cycles per us. 32-bit math only, the kernel has no 64-bit division.
+  perus = (uint)(rdtsc() - tsc) / ((start - now) / 1000);
+  if(perus)
+    tscmult = (1000 << 20) / perus;
+  tsccalibrated = 1;
+}
+
+// Convert a TSC cycle count to ns. The high and low 20 bits of
+// cycles are scaled apart, so a 64-bit product only overflows after
+// 2^54 cycles, years at any clock rate.
+unsigned long long
+tsc2ns(unsigned long long cycles)
+{
+  return (cycles >> 20) * tscmult + (((cycles & 0xFFFFF) * tscmult) >> 20);
+}
+
 void
 lapicinit(void)
 {
@@ -67,6 +108,8 @@ lapicinit(void)
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
   lapicw(TICR, 10000000);
+  if(!tsccalibrated)
+    tsccalibrate();
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,6 +156,20 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send an interrupt with the given vector to the cpu
+// with the given APIC ID. Must be called with interrupts
+// disabled, so the two ICR writes aren't interleaved.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -7,16 +7,23 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "traps.h"
+#include "procinfo.h"
 
 
 extern PriorityQueue pq;
 extern RoundRobinQueue rrq;
+extern MultiLevelFeedbackQueue mlfq;
+extern RealTimeQueue rtq;
 extern RunningProcessesHolder rpholder;
 
-static void (*sched_policy_arr[])(struct cpu*) = {
+static int (*sched_policy_arr[])(struct cpu*) = {
 [SP_rrs]  sp_round_robin, 
 [SP_ps]   sp_priority,
 [SP_eps]  sp_ext_priority,
+[SP_cfs]  sp_cfs,
+[SP_mlfq] sp_mlfq,
+[SP_stride] sp_stride,
 
 }; 
 
@@ -24,12 +31,45 @@ static int current_sched_strat = 1;      // (Added By Ido & Dan) holds the curre
 
 static long long tq_timestamp = 1;       // accumulates the number of timestamp since the OS initiated
 
+static uint mlfq_boosted;                // ticks at the last SP_mlfq boost
+
+static uint migrated;                    // processes the load balancer moved since boot
+static uint migrated_mark;               // migrated at the start of the current second
+static uint migrated_rate;               // processes moved during the last second
+
 //Schedule policies Strategy Array:
 
+// The key of p in the priority queue and the running holder:
+// its vruntime under SP_cfs, its level under SP_mlfq, its pass
+// under SP_stride, and its accumulator otherwise.
 long long getAccumulator(struct proc *p) {
+	if(current_sched_strat == SP_cfs)
+		return p->vruntime;
+	if(current_sched_strat == SP_mlfq)
+		return p->level;
+	if(current_sched_strat == SP_stride)
+		return p->pass;
 	return p->accumulator;
 }
 
+// The weight of p in its run queue's load, for the load balancer:
+// its share of the cpus, 1024 for a default process.
+int getWeight(struct proc *p) {
+	if(current_sched_strat == SP_rrs || current_sched_strat == SP_mlfq)
+		return 1024;
+	if(current_sched_strat == SP_stride)
+		return p->tickets * 1024 / STRIDE_TICKETS;
+	return 1024 * NP_PRIORITY / (p->priority ? p->priority : 1);
+}
+
+// The vruntime step of a ns of running, in 1024ths, per priority.
+// It is proportional to the priority, like the accumulator step,
+// so a process gets a cpu share inversely proportional to it.
+// Priority NP_PRIORITY is a step of 1 and 0 counts as 1.
+static const uint cfs_scale[] = {
+  205, 205, 410, 614, 819, 1024, 1229, 1434, 1638, 1843, 2048
+};
+
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
@@ -42,6 +82,15 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void idle(struct cpu *c);
+static void wakeidle(struct proc *p);
+static void preempt(struct proc *p);
+static void charge(struct proc *p);
+static void account(struct proc *p);
+static long long cfs_place(long long vruntime);
+static long long stride_place(long long pass);
+static void mlfq_boost(void);
+static int sp_realtime(struct cpu *c);
 
 void
 pinit(void)
@@ -111,6 +160,12 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  memset(p->lat, 0, sizeof(p->lat));
+  p->maxlat = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  p->stime = p->retime = p->rutime = 0;
+  p->stime_ns = p->retime_ns = p->rutime_ns = 0;
 
   release(&ptable.lock);
 
@@ -171,14 +226,26 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
-
-  enqueue_by_state(p);
-
   p->priority = NP_PRIORITY;
+  p->level = 0;
+  p->tickets = STRIDE_TICKETS;
+  p->stride = STRIDE1 / STRIDE_TICKETS;
+  p->affinity = AFFINITY_ALL;
+  p->last_cpu = -1;
 
   if(current_sched_strat == SP_ps)
     p->accumulator = get_min_acc(); 
+  else if(current_sched_strat == SP_cfs)
+    p->vruntime = get_min_acc();
+  else if(current_sched_strat == SP_stride)
+    p->pass = get_min_acc();
+
+  account(p);
+  p->state = RUNNABLE;
+  p->readytsc = rdtsc();
+
+  // Enqueue last: once queued, another cpu may pick the process.
+  enqueue_by_state(p);
 
   release(&ptable.lock);
 }
@@ -246,17 +313,32 @@ fork(void)
 
   np->ctime = ticks; 
 
+  np->priority = NP_PRIORITY;
+  np->quantum = 0;
+  np->level = 0;
+  np->tickets = curproc->tickets;
+  np->stride = curproc->stride;
+  np->rt = 0;
+  np->misses = 0;
+  np->affinity = curproc->affinity;
+  np->last_cpu = -1;
+
+  if(current_sched_strat == SP_ps)
+    np->accumulator = get_min_acc();  
+  else if(current_sched_strat == SP_cfs)
+    np->vruntime = get_min_acc();
+  else if(current_sched_strat == SP_stride)
+    np->pass = get_min_acc();
+
+  account(np);
   np->state = RUNNABLE;
+  np->readytsc = rdtsc();
 
   update_pref_field(-ticks, RETIME, np);
   
+  // Enqueue last: once queued, another cpu may pick the process.
   enqueue_by_state(np);
 
-  np->priority = NP_PRIORITY;
-
-  if(current_sched_strat == SP_ps)
-    np->accumulator = get_min_acc();  
-
   release(&ptable.lock);
 
   return pid;
@@ -305,7 +387,8 @@ exit(int status)
   curproc->status = status;
 
   // Jump into the scheduler, never to return.
-  update_pref_field(-ticks, RUTIME, curproc);
+  update_pref_field(ticks, RUTIME, curproc);
+  account(curproc);
   curproc->state = ZOMBIE;
   curproc->ttime = ticks;
   sched();
@@ -376,12 +459,172 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    sched_policy_arr[current_sched_strat](c);
-    release(&ptable.lock);
+    // Pick a process from the run queues. They have locks of
+    // their own, so an idle cpu doesn't contend ptable.lock;
+    // the policy takes it only to switch to the picked process.
+    // Real-time processes run first, whatever the policy.
+    // Halt when there is nothing to run.
+    if(!sp_realtime(c) && !sched_policy_arr[current_sched_strat](c))
+      idle(c);
+  }
+}
 
+// Is any process queued for the current policy? A lockless hint.
+static int
+queued(void)
+{
+  if(!rtq.isEmpty())
+    return 1;
+  if(current_sched_strat == SP_rrs)
+    return !rrq.isEmpty();
+  if(current_sched_strat == SP_mlfq)
+    return !mlfq.isEmpty();
+  return !pq.isEmpty();
+}
+
+// Halt this cpu until an interrupt arrives, unless a process
+// was queued meanwhile. c->idle is set before the queues are
+// checked, and enqueuers check it after queueing (the fences are
+// in __sync_synchronize and release), so either this cpu sees the
+// process or the enqueuer sees c->idle and sends an IPI.
+static void
+idle(struct cpu *c)
+{
+  unsigned long long start;
+
+  cli();
+  c->idle = 1;
+  __sync_synchronize();
+  if(!queued()){
+    start = rdtsc();
+    stihlt();
+    cli();
+    c->idlecycles += rdtsc() - start;
   }
+  c->idle = 0;
+  sti();
+}
+
+// Wake a halted cpu, if there is one, to run the queued process p.
+// The cpu whose run queue holds the process goes first, and only
+// the cpus of its affinity mask may take it. The real-time queue is
+// shared, so p->rqcpu means nothing there.
+static void
+wakeidle(struct proc *p)
+{
+  struct cpu *c;
+
+  pushcli();
+  c = p->rt ? mycpu() : &cpus[p->rqcpu];
+  if(c->idle && c != mycpu()){
+    c->idle = 0;
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+    popcli();
+    return;
+  }
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c->idle && c != mycpu() && (p->affinity & (1 << (c-cpus)))){
+      c->idle = 0;  // so other enqueuers wake another cpu
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+      break;
+    }
+  }
+  popcli();
+}
+
+// Does a run after b under earliest deadline first? Real-time
+// processes run before the others, earlier deadlines first.
+static int
+rtlater(struct proc *a, struct proc *b)
+{
+  if(!a->rt || !b->rt)
+    return !a->rt && b->rt;
+  return a->deadline > b->deadline;
+}
+
+// A woken real-time process preempts a process of the policies,
+// or else the running real-time process with the latest deadline,
+// if that is later than its own.
+// The ptable lock must be held, so c->proc is stable.
+static void
+rtpreempt(struct proc *p)
+{
+  struct cpu *c, *victim = 0;
+
+  pushcli();
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(!(p->affinity & (1 << (c-cpus))))
+      continue;
+    if(!c->proc){
+      victim = 0;  // a cpu p may run on is between processes, it will pick p
+      break;
+    }
+    if(!victim || rtlater(c->proc, victim->proc))
+      victim = c;
+  }
+
+  if(victim && rtlater(victim->proc, p)){
+    victim->resched = 1;
+    if(victim != mycpu())
+      lapicipi(victim->apicid, T_IRQ0 + IRQ_WAKEUP);
+  }
+  popcli();
+}
+
+// Under the priority policies, a woken process that should run
+// before the lowest priority running process (the one with the
+// biggest accumulator, or vruntime) preempts it now instead of at its cpu's
+// next tick. rpholder only keeps the smallest running accumulator,
+// so the victim is found by scanning the cpus.
+// The ptable lock must be held, so c->proc is stable.
+static void
+preempt(struct proc *p)
+{
+  struct cpu *c, *victim = 0;
+  long long running;
+
+  if(p->rt){
+    rtpreempt(p);
+    return;
+  }
+  if(current_sched_strat == SP_rrs)
+    return;
+  if(!rpholder.getMinAccumulator(&running))
+    return;  // nothing is running, the scheduling cpus will pick p
+
+  pushcli();
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(!(p->affinity & (1 << (c-cpus))))
+      continue;
+    if(!c->proc){
+      victim = 0;  // a cpu p may run on is between processes, it will pick p
+      break;
+    }
+    if(c->proc->rt)
+      continue;  // the policies never preempt the real-time class
+    if(!victim || getAccumulator(c->proc) > getAccumulator(victim->proc))
+      victim = c;
+  }
+
+  if(victim && getAccumulator(p) < getAccumulator(victim->proc)){
+    victim->resched = 1;
+    if(victim != mycpu())
+      lapicipi(victim->apicid, T_IRQ0 + IRQ_WAKEUP);
+  }
+  popcli();
+}
+
+// Called by trap(): should the running process give up the cpu
+// because a woken process preempted it? sched() clears the request.
+int
+reschedule(void)
+{
+  int ans;
+
+  pushcli();
+  ans = mycpu()->resched;
+  popcli();
+  return ans;
 }
 
 // Enter scheduler.  Must hold only ptable.lock
@@ -405,26 +648,49 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  // However p leaves the cpu, a preemption of it is done with. The
+  // ptable lock keeps preempt() from setting a new one meanwhile.
+  mycpu()->resched = 0;
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
 }
 
 // Give up the CPU for one scheduling round.
-void
-yield(void)
+// expired is set when the time slice was used up.
+static void
+yield1(int expired)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
   struct proc *p = myproc();
+  charge(p);
+  if(expired && current_sched_strat == SP_mlfq && p->level < MLFQ_LEVELS-1)
+    p->level++;
   //myproc()->state = RUNNABLE;
   update_pref_field(ticks, RUTIME, p);
+  account(p);
   p->state = RUNNABLE;
   update_pref_field(-ticks, RETIME, p);
+  p->nivcsw++;
   enqueue_by_state(p);
   sched();
   release(&ptable.lock);
 }
 
+void
+yield(void)
+{
+  yield1(0);
+}
+
+// Give up the CPU because the time slice is over.
+// Under SP_mlfq the process drops a level.
+void
+expire(void)
+{
+  yield1(1);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -471,10 +737,13 @@ sleep(void *chan, struct spinlock *lk)
   }
   // Go to sleep.
   p->chan = chan;
+  charge(p);
 
-  update_pref_field(-ticks, RUTIME, p);
+  update_pref_field(ticks, RUTIME, p);
 
+  account(p);
   p->state = SLEEPING;
+  p->nvcsw++;
 
   update_pref_field(-ticks, STIME, p);
 
@@ -501,12 +770,18 @@ wakeup1(void *chan)
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan){
       update_pref_field(ticks, STIME, p);
+      account(p);
       p->state = RUNNABLE;
+      p->readytsc = rdtsc();
       update_pref_field(-ticks, RETIME, p);
       if(current_sched_strat == SP_ps)
         p->accumulator = get_min_acc(); 
+      else if(current_sched_strat == SP_cfs)
+        p->vruntime = cfs_place(p->vruntime);
+      else if(current_sched_strat == SP_stride)
+        p->pass = stride_place(p->pass);
       enqueue_by_state(p);
-
+      preempt(p);
     }
 }
 
@@ -534,7 +809,9 @@ kill(int pid)
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING){
         update_pref_field(ticks, STIME, p);
+        account(p);
         p->state = RUNNABLE;
+        p->readytsc = rdtsc();
         update_pref_field(-ticks, RETIME, p);
         enqueue_by_state(p);
       }
@@ -581,6 +858,10 @@ procdump(void)
     }
     cprintf("\n");
   }
+  for(i = 0; i < ncpu; i++)
+    cprintf("cpu %d: %d Kcycles idle\n", i, (uint)(cpus[i].idlecycles >> 10));
+  lockdump(&ptable.lock);
+  dumpSchedDS();
 }
 /*
   if(parent has child with @pid){
@@ -619,13 +900,250 @@ priority(int priority)
 }
 
 
+// Set the quantum of the current process, in ticks. 0 derives it
+// from the priority again. Returns -1 if n is out of bounds.
+int
+quantum(int n)
+{
+  if(n < 0 || n > QUANTUM_MAX)
+    return -1;
+
+  myproc()->quantum = n;
+  return 0;
+}
+
+// Set the tickets of the current process, its share under SP_stride.
+// Returns -1 if n is out of bounds.
+int
+tickets(int n)
+{
+  struct proc *p = myproc();
+
+  if(n < 1 || n > STRIDE_MAX_TICKETS)
+    return -1;
+
+  acquire(&ptable.lock);  // charge() reads the stride
+  p->tickets = n;
+  p->stride = STRIDE1 / n;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Put the current process in the real-time class: every period
+// ticks a job starts, which must be done before the next one, and
+// may run for budget ticks. A period of 0 leaves the class.
+// Returns -1 if the budget doesn't fit in the period.
+int
+realtime(int period, int budget)
+{
+  struct proc *p = myproc();
+
+  if(period != 0 && (budget < 1 || budget > period))
+    return -1;
+
+  acquire(&ptable.lock);
+  p->rt = period != 0;
+  p->period = period;
+  p->budget = budget;
+  p->used = 0;
+  p->deadline = ticks + period;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Called by trap() on every timer tick of every cpu. The cpus take
+// turns moving queued processes from the most loaded run queue to
+// the least loaded one, each every BALANCE_TICKS ticks.
+void
+balance(void)
+{
+  int moved;
+
+  if(cpuid() == 0 && ticks % SECOND_TICKS == 0){
+    migrated_rate = migrated - migrated_mark;
+    migrated_mark = migrated;
+  }
+
+  if((ticks + cpuid()) % BALANCE_TICKS)
+    return;
+  moved = balanceSchedDS();
+  if(moved)
+    __sync_fetch_and_add(&migrated, moved);
+}
+
+// The number of processes the load balancer moved since boot.
+// The number it moved during the last second goes in *persec,
+// unless persec is 0.
+int
+migrations(int *persec)
+{
+  if(persec)
+    *persec = migrated_rate;
+  return migrated;
+}
+
+// Copies a snapshot of up to max processes that aren't UNUSED to
+// info, in ptable order, and returns how many it copied. The tick
+// totals only add up at a change of state, so the stretch in the
+// current state is added here: its start was subtracted on entry.
+int
+getprocinfo(struct procinfo *info, int max)
+{
+  struct proc *p;
+  int n = 0;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && n < max; p++){
+    if(p->state == UNUSED)
+      continue;
+    info[n].pid = p->pid;
+    info[n].state = p->state;
+    safestrcpy(info[n].name, p->name, sizeof(info[n].name));
+    info[n].priority = p->priority;
+    info[n].accumulator = getAccumulator(p);
+    info[n].stime = p->stime + (p->state == SLEEPING ? ticks : 0);
+    info[n].retime = p->retime + (p->state == RUNNABLE ? ticks : 0);
+    info[n].rutime = p->rutime + (p->state == RUNNING ? ticks : 0);
+    info[n].last_cpu = p->last_cpu;
+    n++;
+  }
+  release(&ptable.lock);
+  return n;
+}
+
+// Called by trap() on every tick, on cpu 0 only, before the
+// sleepers on ticks are woken: end the periods that are over.
+// A real-time process that is runnable, running, or throttled at
+// the end of a period didn't finish its job in time.
+void
+rttick(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(!p->rt || p->state == UNUSED || p->state == EMBRYO || p->state == ZOMBIE)
+      continue;
+    if(ticks < p->deadline)
+      continue;
+
+    if(p->state != SLEEPING || p->chan == &p->used)
+      p->misses++;
+    p->deadline += (ticks - p->deadline) / p->period * p->period + p->period;
+    p->used = 0;
+
+    if(p->state == RUNNABLE && rtq.extractProc(p))
+      rtq.put(p);  // requeue under the new deadline
+    else if(p->state == SLEEPING && p->chan == &p->used)
+      wakeup1(&p->used);
+  }
+  release(&ptable.lock);
+}
+
+// Called by trap() on a timer tick: charge the tick to the running
+// process's budget. Returns 1 if it is a real-time process that
+// used up the budget of its period.
+int
+rtcharge(void)
+{
+  struct proc *p = myproc();
+  int over;
+
+  if(!p->rt)
+    return 0;
+
+  acquire(&ptable.lock);
+  over = ++p->used >= p->budget;
+  release(&ptable.lock);
+  return over;
+}
+
+// Sleep until the next period of the current process, which used up
+// its budget. rttick() wakes it.
+void
+throttle(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&ptable.lock);
+  while(p->rt && p->used >= p->budget && !p->killed)
+    sleep(&p->used, &ptable.lock);
+  release(&ptable.lock);
+}
+
+// Let the process pid run only on the cpus of mask, a bit per cpu.
+// If it is running elsewhere, it moves at its next trap; if it is
+// queued elsewhere, when it is picked. Returns -1 if there is no
+// such process, or mask has no online cpu.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  struct cpu *c;
+
+  mask &= (1 << ncpu) - 1;
+  if(!mask)
+    return -1;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid || p->state == UNUSED)
+      continue;
+    // The real-time queue counts its processes by the cpus that may
+    // take them, so a queued one is requeued under the new mask.
+    if(p->rt && p->state == RUNNABLE && rtq.extractProc(p)){
+      p->affinity = mask;
+      rtq.put(p);
+      wakeidle(p);
+    } else
+      p->affinity = mask;
+    pushcli();
+    for(c = cpus; c < cpus+ncpu; c++){
+      if(c->proc == p && !(mask & (1 << (c-cpus)))){
+        c->resched = 1;
+        if(c != mycpu())
+          lapicipi(c->apicid, T_IRQ0 + IRQ_WAKEUP);
+      }
+    }
+    popcli();
+    release(&ptable.lock);
+    return 0;
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Do the keys of the policy mean anything but the accumulator?
+static int
+own_keys(int policy)
+{
+  return policy == SP_cfs || policy == SP_mlfq || policy == SP_stride;
+}
+
 void 
 policy (int policy_iden)
 {
 
-  if(/*policy_iden != current_sched_strat && */policy_iden<=3 && policy_iden>0){//new_policy!=curr_policy && 0<new_policy<=3
+  if(/*policy_iden != current_sched_strat && */policy_iden<=SP_stride && policy_iden>0){//new_policy!=curr_policy && 0<new_policy<=6
     acquire(&ptable.lock);
-    if(policy_iden == SP_eps && current_sched_strat == SP_rrs)//new_policy = 3 && curr_policy = 1
+    if(own_keys(policy_iden) || own_keys(current_sched_strat)){
+      // The queue, or the meaning of its keys, changes. Gather every
+      // process in the round robin queue, and requeue it with all the
+      // keys reset, like a switch from round robin does.
+      reset_sched_keys();
+      if(policy_iden == SP_ps)
+        set_filtered_priorities(0,1);
+      if(current_sched_strat == SP_mlfq)
+        mlfq.switchToRoundRobinPolicy();
+      else if(current_sched_strat != SP_rrs)
+        pq.switchToRoundRobinPolicy();
+      if(policy_iden == SP_mlfq)
+        mlfq.switchFromRoundRobinPolicy();
+      else if(policy_iden != SP_rrs)
+        rrq.switchToPriorityQueuePolicy();
+    }
+
+    else if(policy_iden == SP_eps && current_sched_strat == SP_rrs)//new_policy = 3 && curr_policy = 1
       rrq.switchToPriorityQueuePolicy();
     
 
@@ -641,6 +1159,9 @@ policy (int policy_iden)
     }
 
     current_sched_strat = policy_iden;
+    // The running processes were keyed under the old policy, and
+    // get_min_acc() must not hand their old keys to the woken ones.
+    rpholder.rekey();
     release(&ptable.lock); 
   }
 
@@ -680,6 +1201,14 @@ wait_stat(int* status, struct perf* performace)
         performace->stime = p->stime;
         performace->retime = p->retime;
         performace->rutime = p->rutime;
+        performace->misses = p->misses;
+        memmove(performace->lat, p->lat, sizeof(p->lat));
+        performace->maxlat = p->maxlat > 0xffffffff ? 0xffffffff : p->maxlat;
+        performace->nvcsw = p->nvcsw;
+        performace->nivcsw = p->nivcsw;
+        performace->stime_ns = p->stime_ns;
+        performace->retime_ns = p->retime_ns;
+        performace->rutime_ns = p->rutime_ns;
 
         p->state = UNUSED;
 
@@ -709,6 +1238,19 @@ void set_all_accumulators(int value){
     p->accumulator = value;
 }
 
+// Start every process over under the next policy: reset the
+// accumulators, the vruntimes, the levels and the passes.
+void reset_sched_keys(void){
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    p->accumulator = RRS_ACC_VAL;
+    p->vruntime = 0;
+    p->level = 0;
+    p->pass = 0;
+  }
+}
+
 void set_filtered_priorities(int filter, int value){
   struct proc *p;
 
@@ -719,31 +1261,99 @@ void set_filtered_priorities(int filter, int value){
 
 //enqueue according to state:
 void enqueue_by_state(struct proc* p){
-  if(current_sched_strat == SP_rrs)
+  if(p->rt)
+    rtq.put(p);
+  else if(current_sched_strat == SP_rrs)
     rrq.enqueue(p); 
-  else if(current_sched_strat == SP_ps || current_sched_strat == SP_eps)
+  else if(current_sched_strat == SP_ps || current_sched_strat == SP_eps || current_sched_strat == SP_cfs ||
+          current_sched_strat == SP_stride)
     pq.put(p); 
+  else if(current_sched_strat == SP_mlfq)
+    mlfq.enqueue(p);
   else
     panic("incorrect scheduling strategy state\n"); 
+  wakeidle(p);
 }
 
-void swtch_to_proc(struct proc* p, struct cpu* c){
+// The ns from the rdtsc() reading then to now. The cpus' TSCs may
+// disagree a little, so a reading from another cpu may be ahead of
+// now: that counts as 0.
+static unsigned long long
+tsc_since(unsigned long long then, unsigned long long now)
+{
+  return now > then ? tsc2ns(now - then) : 0;
+}
+
+// Adds the time since p's last change of state to the ns total of the
+// state it's leaving. Call it right before changing p->state. Unlike
+// the tick totals, a run shorter than a tick is not lost or rounded up.
+static void
+account(struct proc *p)
+{
+  unsigned long long now = rdtsc();
+  unsigned long long ns = tsc_since(p->statetsc, now);
+
+  if(p->state == RUNNING)
+    p->rutime_ns += ns;
+  else if(p->state == RUNNABLE)
+    p->retime_ns += ns;
+  else if(p->state == SLEEPING)
+    p->stime_ns += ns;
+  p->statetsc = now;
+}
+
+// Files the time since p was woken in its latency histogram, see
+// struct perf. p is about to run.
+static void
+record_latency(struct proc *p)
+{
+  unsigned long long ns = tsc_since(p->readytsc, p->runtsc);
+  unsigned long long units = ns >> LAT_SHIFT;
+  int bucket = 0;
+
+  while(units >= 2 && bucket < LAT_BUCKETS-1){
+    units >>= 1;
+    bucket++;
+  }
+  p->lat[bucket]++;
+  if(ns > p->maxlat)
+    p->maxlat = ns;
+  p->readytsc = 0;
+}
+
+// Returns 0 without switching if p may not run on c: setaffinity()
+// changed its mask while it was queued. It is requeued on a cpu in
+// the mask instead.
+int swtch_to_proc(struct proc* p, struct cpu* c){
+  if(!(p->affinity & (1 << (c-cpus)))){
+    enqueue_by_state(p);
+    preempt(p);
+    return 0;
+  }
+
   // Switch to chosen process.  It is the process's job
   // to release ptable.lock and then reacquire it
   // before jumping back to us.
   c->proc = p;
+  p->last_cpu = c-cpus;
   switchuvm(p);
 
   update_pref_field(ticks, RETIME, p);
 
+  account(p);
   p->state = RUNNING;
 
   update_pref_field(-ticks, RUTIME, p);
 
   p->last_tq = tq_timestamp; 
   ++tq_timestamp; 
+  p->runtsc = rdtsc();
+  p->slice = 0;
+  if(p->readytsc)
+    record_latency(p);
 
-  rpholder.add(p); 
+  if(!p->rt)
+    rpholder.add(p);  // its key would only skew get_min_acc()
 
   swtch(&(c->scheduler), p->context);
   switchkvm();
@@ -756,31 +1366,189 @@ void swtch_to_proc(struct proc* p, struct cpu* c){
 
 
   rpholder.remove(p);
+  return 1;
 }
 
 //Round Robin Sheduling Algorithm:
-void sp_round_robin (struct cpu* c){
-  if(!rrq.isEmpty()){
-    struct proc *p = rrq.dequeue(); 
+//The policies pick a process without ptable.lock and take it only
+//to switch. A queued process stays RUNNABLE until it's picked, so
+//the picked process is still RUNNABLE once the lock is held.
+//Each policy returns 1 iff it ran a process.
+int sp_round_robin (struct cpu* c){
+  struct proc *p = rrq.dequeue(); 
+  if(p){
+    acquire(&ptable.lock);
     swtch_to_proc(p, c); 
+    release(&ptable.lock);
   }
+  return p != null;
 }
 
 //Priority Scheduling Algorithm:
 
-void sp_priority (struct cpu* c){
-  if(!pq.isEmpty()){
-    
-    struct proc *p = pq.extractMin(); 
+int sp_priority (struct cpu* c){
+  struct proc *p = pq.extractMin(); 
+  if(p){
+    acquire(&ptable.lock);
+    swtch_to_proc(p, c);
+    release(&ptable.lock);
+  }
+  return p != null;
+}
+
+//Completely Fair Scheduling Algorithm:
+//The priority queue is keyed by vruntime, see getAccumulator().
+//charge() advances the vruntime when the process stops running.
+int sp_cfs (struct cpu* c){
+  struct proc *p = pq.extractMin(); 
+  if(p){
+    acquire(&ptable.lock);
     swtch_to_proc(p, c); 
+    release(&ptable.lock);
+  }
+  return p != null;
+}
 
-    if(p->state == RUNNABLE){
-      p->accumulator += p->priority;  
-      //pq.put(p);
-    }
+// Add the time p ran since it was switched to, or last charged, to
+// its vruntime and its pass, and the ticks of its slice to its
+// accumulator under the priority policies. Called with ptable.lock
+// held, before p is requeued under its key.
+static void
+charge(struct proc *p)
+{
+  unsigned long long now = rdtsc();
+  unsigned long long ns = tsc2ns(now - p->runtsc);
+
+  p->vruntime += (ns * cfs_scale[p->priority]) >> 10;
+  p->pass += (ns * p->stride) >> STRIDE_SHIFT;
+  p->runtsc = now;
+  if(current_sched_strat == SP_ps || current_sched_strat == SP_eps)
+    p->accumulator += p->priority * (p->slice ? p->slice : 1);
+}
+
+// The vruntime of a woken process: a sleeper may not lag more than
+// CFS_WAKEUP_CREDIT behind the min vruntime, or it would hog the cpu
+// until it caught up.
+static long long
+cfs_place(long long vruntime)
+{
+  long long floor = get_min_acc() - CFS_WAKEUP_CREDIT;
+  return vruntime < floor ? floor : vruntime;
+}
+
+// The ticks a run of p may last under the policies that don't
+// time their own slices: set by quantum(), or else the priority.
+// Low priorities (big numbers) are batch work, so they run longer
+// and switch less; the priority policies charge the accumulator
+// per tick run, so their shares don't change.
+static int
+quantum_of(struct proc *p)
+{
+  if(p->quantum)
+    return p->quantum;
+  return p->priority ? p->priority : 1;
+}
+
+// Called by trap() on a timer tick: has the running process used up
+// its time slice? Under SP_cfs, CFS_LATENCY is split between the
+// running process and the ones queued on its cpu, which are the ones
+// it shares the cpu with, and no slice is shorter than
+// CFS_MIN_SLICE. Under SP_mlfq the slice doubles every level down.
+// The other policies switch once the quantum is over, see quantum_of().
+int
+sliceover(void)
+{
+  struct proc *p = myproc();
+  uint slice;
+
+  p->slice++;
+  if(p->rt)
+    return 0;  // only throttle() and earlier deadlines stop a real-time process
+
+  if(current_sched_strat == SP_mlfq)
+    return tsc2ns(rdtsc() - p->runtsc) >= (unsigned long long)MLFQ_QUANTUM << p->level;
+
+  if(current_sched_strat != SP_cfs)
+    return p->slice >= quantum_of(p);
+
+  slice = CFS_LATENCY / (sizeSchedDS(cpuid()) + 1);
+  if(slice < CFS_MIN_SLICE)
+    slice = CFS_MIN_SLICE;
+  return tsc2ns(rdtsc() - p->runtsc) >= slice;
+}
+
+//Earliest Deadline First Scheduling Algorithm:
+//The real-time class, tried before the policy by scheduler().
+//Deadlines are set by realtime() and moved on by rttick().
+//The queue only hands out the processes this cpu may run. One whose
+//mask changed since goes back to it, and the policy gets the cpu.
+static int sp_realtime (struct cpu* c){
+  struct proc *p = rtq.extractMin(); 
+  int ran = 0;
+  if(p){
+    acquire(&ptable.lock);
+    ran = swtch_to_proc(p, c); 
+    release(&ptable.lock);
+  }
+  return ran;
+}
+
+//Stride Scheduling Algorithm:
+//The priority queue is keyed by pass, see getAccumulator(), and the
+//process with the min pass of all the cpus runs next, so every process
+//gets a share of the machine proportional to its tickets.
+//charge() advances the pass when the process stops running.
+int sp_stride (struct cpu* c){
+  struct proc *p = pq.extractGlobalMin(); 
+  if(p){
+    acquire(&ptable.lock);
+    swtch_to_proc(p, c); 
+    release(&ptable.lock);
+  }
+  return p != null;
+}
+
+// The pass of a woken process: a sleeper doesn't bank the time it
+// slept, it rejoins at the min pass.
+static long long
+stride_place(long long pass)
+{
+  long long floor = get_min_acc();
+  return pass < floor ? floor : pass;
+}
+
+//Multi Level Feedback Queue Scheduling Algorithm:
+//A process that uses up its time slice drops a level (see expire()),
+//and one that sleeps before that keeps its level. Every MLFQ_BOOST
+//ticks every process goes back to level 0, so none starves.
+int sp_mlfq (struct cpu* c){
+  struct proc *p;
 
+  if(ticks - mlfq_boosted >= MLFQ_BOOST)
+    mlfq_boost();
+
+  p = mlfq.dequeue();
+  if(p){
+    acquire(&ptable.lock);
+    swtch_to_proc(p, c);
+    release(&ptable.lock);
   }
+  return p != null;
+}
 
+static void
+mlfq_boost(void)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  if(ticks - mlfq_boosted >= MLFQ_BOOST){  // another cpu may have boosted meanwhile
+    mlfq_boosted = ticks;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      p->level = 0;
+    mlfq.boost();
+  }
+  release(&ptable.lock);
 }
 
 long long get_min_acc(){
@@ -802,45 +1570,25 @@ long long min (long long a, long long b){
 
 //Extended Priority Scheduling Algorithm:
 
-void sp_ext_priority (struct cpu* c){
-
-  if(!pq.isEmpty()){
-    
-    struct proc *p = proc_to_run(); 
-
-    swtch_to_proc(p, c); 
-
-    if(p->state == RUNNABLE){
-      p->accumulator += p->priority;  
-      //pq.put(p);
-    }
+int sp_ext_priority (struct cpu* c){
+  struct proc *p = proc_to_run(c); 
+  if(p){
+    acquire(&ptable.lock);
+    swtch_to_proc(p, c);
+    release(&ptable.lock);
   }
-
+  return p != null;
 }
 
-struct proc* proc_to_run(void){
+struct proc* proc_to_run(struct cpu* c){
+  struct proc *p = null;
   if(tq_timestamp%TQ_THRESHOLD == 0)
-    return proc_with_min_timestamp(); 
+    p = pq.extractLeastRecent(); 
 
-  return pq.extractMin(); 
-  
-}
-
-struct proc* proc_with_min_timestamp(void) {
+  if(!p)
+    p = pq.extractMin(); 
 
-  struct proc *p;
-  struct proc *result = null;
-  long long min_timestamp = LLONG_MAX;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == RUNNABLE && min_timestamp > p->last_tq){
-      min_timestamp = p->last_tq;
-      result = p; 
-    }
-
-  }
-  pq.extractProc(result);
-  return result;
+  return p;
 }
 
 
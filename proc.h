@@ -4,6 +4,9 @@
 #define SP_rrs    1
 #define SP_ps     2
 #define SP_eps    3
+#define SP_cfs    4
+#define SP_mlfq   5
+#define SP_stride 6
 
 // constants for priority
 #define NP_PRIORITY 5
@@ -12,6 +15,34 @@
 #define LLONG_MAX 9223372036854775807
 #define TQ_THRESHOLD 100
 #define RRS_ACC_VAL 0
+#define QUANTUM_MAX 100          // ticks, the longest quantum quantum() may set
+#define AFFINITY_ALL 0xffffffff  // the affinity mask of every cpu
+
+//SP_cfs constants, in ns:
+#define CFS_LATENCY 40000000     // every runnable process runs once within this period...
+#define CFS_MIN_SLICE 4000000    // ...unless that makes the slices shorter than this
+#define CFS_WAKEUP_CREDIT (CFS_LATENCY/2) // the most a woken process may lag behind the min vruntime
+
+//SP_mlfq constants:
+#define MLFQ_LEVELS 8            // level 0 runs first
+#define MLFQ_QUANTUM 10000000    // ns, the time slice at level 0. It doubles every level down
+#define MLFQ_BOOST 100           // ticks between moving every process back to level 0
+
+//SP_stride constants:
+#define STRIDE_TICKETS 100       // the tickets of the first process, the others inherit their parent's
+#define STRIDE_MAX_TICKETS 10000
+#define STRIDE1 (1 << 20)        // the stride of a single ticket
+#define STRIDE_SHIFT 23          // the pass grows by the stride every 2^23 ns (about a tick) run
+
+//load balancing constants:
+#define BALANCE_TICKS 10         // ticks between two balancing rounds of a cpu
+#define BALANCE_BATCH 4          // the most processes a round moves
+#define BALANCE_SCAN 8           // the most processes a round looks at in a priority queue
+#define SECOND_TICKS 100         // a timer tick is 10ms, see lapicinit()
+
+//latency histogram constants:
+#define LAT_BUCKETS 20           // bucket i counts latencies of [2^i, 2^(i+1)) units, the ends also the rest
+#define LAT_SHIFT 10             // a unit is 2^10 ns, about a microsecond
 
 //performace field identifiers:
 #define CTIME 1
@@ -27,6 +58,14 @@ struct perf {
   int stime;
   int retime;
   int rutime;
+  int misses;                    // deadline misses of a real-time process
+  uint lat[LAT_BUCKETS];         // wakeup-to-run latencies, a log2 histogram
+  uint maxlat;                   // the longest wakeup-to-run latency, in ns. Saturates
+  int nvcsw;                     // voluntary context switches: sleeps
+  int nivcsw;                    // involuntary context switches: preemptions and expired slices
+  unsigned long long stime_ns;   // stime, retime and rutime, in ns rather than ticks
+  unsigned long long retime_ns;
+  unsigned long long rutime_ns;
 };
 
 
@@ -40,6 +79,9 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile int idle;           // Is the cpu halted, waiting for work?
+  volatile int resched;        // Should the running process yield at the next trap?
+  unsigned long long idlecycles; // Total cycles spent halted
 };
 
 extern struct cpu cpus[NCPU];
@@ -66,6 +108,43 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Intrusive hooks of the scheduling data structures (see ass1ds.cpp).
+// The structures link processes through these fields, so they never allocate.
+struct schedlink {               // doubly linked list hook
+  struct proc *next;
+  struct proc *prev;
+};
+
+struct schedtree {               // red-black tree hook
+  struct proc *parent;
+  struct proc *left;
+  struct proc *right;
+  long long key;                 // the accumulator, deadline or last_tq when the process was put
+  long long seq;                 // put order, keeps equal keys FIFO
+  int red;
+};
+
+struct schedbucket {             // radix heap hook, a circular list
+  struct proc *next;
+  struct proc *prev;
+  long long key;                 // the accumulator when the process was put
+  int bucket;                    // 1 + index of the bucket holding the process, or 0
+};
+
+struct schedpair {               // pairing heap hook
+  struct proc *child;            // the first child
+  struct proc *next;             // the next sibling
+  struct proc *prev;             // the previous sibling, or the parent of a first child
+  long long key;                 // the accumulator when the process was put
+  long long seq;                 // put order, keeps equal keys FIFO
+};
+
+struct schedheap {               // array based binary heap hook
+  int index;                     // 1 + slot in the heap array, or 0 when not in a heap
+  long long key;                 // the accumulator when the process was added
+  long long seq;                 // add order, keeps equal keys FIFO
+};
+
 // Per-process state
 struct proc {
   uint sz;                       // Size of process memory (bytes)
@@ -87,12 +166,50 @@ struct proc {
   long long accumulator;         // priority's accumulator
   int priority;                  // process's priority
   long long last_tq;             // a number indicating the last time the process has run
+  int quantum;                   // ticks a run may last, 0 derives it from the priority
+  int slice;                     // timer ticks taken in the current run
+  long long vruntime;            // SP_cfs: ns run, weighted by priority
+  unsigned long long runtsc;     // rdtsc() when the process was switched to, or last charged
+  unsigned long long readytsc;   // rdtsc() when the process was woken, 0 once it has run since
+  int level;                     // SP_mlfq: the queue level, 0 is the highest
+  int tickets;                   // SP_stride: the process's share of the cpus
+  uint stride;                   // SP_stride: STRIDE1 / tickets
+  long long pass;                // SP_stride: grows by the stride every quantum run
+  int rt;                        // is the process in the real-time class?
+  uint period;                   // real-time: ticks between the starts of two jobs
+  uint budget;                   // real-time: ticks the process may run every period
+  uint used;                     // real-time: ticks run in the current period
+  uint deadline;                 // real-time: the end of the current period, in ticks
+  int misses;                    // real-time: periods that ended before their job did
+
+  struct schedlink rqlink;       // round robin queue hook
+  struct schedtree agetree;      // priority queue's last_tq order hook
+  struct schedheap rpnode;       // running processes holder hook
+  union {                        // priority queue hook, only the built backend's one is used
+    struct schedtree pqtree;     // red-black tree backend, and the real-time queue
+    struct schedpair pqpair;     // pairing heap backend
+    struct schedheap pqheap;     // binary heap backend
+    struct schedbucket pqbucket; // radix heap backend
+  };
+  int rqcpu;                     // the cpu whose run queue holds this process
+  int rqweight;                  // getWeight() when queued, part of the run queue's load
+  uint rqaffinity;               // the affinity when queued, counted in the run queue's runnable
+  int last_cpu;                  // the cpu the process last ran on, or -1
+  uint affinity;                 // the cpus the process may run on, a bit per cpu
 
   long long ctime;               // process creation time
   long long ttime;               // process termination time
   long long stime;                // the total time the process spent in the SLEEPING state
   long long retime;              // the total time the process spent in the READY state
   long long rutime;              // the total time the process spent in the RUNNING state
+  unsigned long long statetsc;   // rdtsc() at the last change of state
+  unsigned long long stime_ns;   // stime, retime and rutime, in ns rather than ticks
+  unsigned long long retime_ns;
+  unsigned long long rutime_ns;
+  uint lat[LAT_BUCKETS];         // see struct perf
+  unsigned long long maxlat;     // ns
+  int nvcsw;
+  int nivcsw;
 };
 
 // Process memory is laid out contiguously, low addresses first:
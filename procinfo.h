@@ -0,0 +1,13 @@
+// A snapshot of a process, as getprocinfo() copies it out.
+// Shared by the kernel and the user programs, like stat.h.
+struct procinfo {
+  int pid;
+  int state;                     // enum procstate, see proc.h
+  char name[16];
+  int priority;
+  long long accumulator;         // the key under the current policy: accumulator, vruntime, level or pass
+  int stime;                     // ticks spent SLEEPING, RUNNABLE and RUNNING, each
+  int retime;                    // counting the current stretch in the state
+  int rutime;
+  int last_cpu;                  // the cpu it last ran on, or -1
+};
@@ -8,6 +8,7 @@
 #include "traps.h"
 #include "memlayout.h"
 #include "x86.h"
+#include "procinfo.h"
 
 
 //detach constants:
@@ -21,15 +22,63 @@
 //exit&wait constants:
 #define WPERIOD_E 150
 
+//priority queue stress constants:
+#define PQ_STRESS_CHILDS 40
+
+//cfs constants:
+#define CFS_HOGS 4
+#define CFS_SLEEPS 20
+
+//mlfq constants:
+#define MLFQ_HOGS 4
+#define MLFQ_SLEEPS 20
+
+//stride constants:
+#define STRIDE_LIGHT 100    // tickets of the light hogs
+#define STRIDE_HEAVY 300    // tickets of the heavy hogs
+#define STRIDE_TICKS 300    // how long the hogs compete
+#define STRIDE_SLACK 5      // percent the heavy hogs' share may be off by
+
+//real-time constants, in ticks:
+#define RT_PERIOD 5
+#define RT_BUDGET 2
+#define RT_JOBS 40
+
+//quantum constants, in ticks:
+#define QUANTUM_SHORT 1
+#define QUANTUM_LONG 20
+#define QUANTUM_TICKS 60    // how long the hogs run
+
+//balance constants, in ticks:
+#define BALANCE_RUN 60      // how long the hogs run
+#define BALANCE_LOOK 30     // when, after they are unpinned, to see where they ran
+
+//latency constants:
+#define LAT_BUCKETS 20      // as in proc.h
+#define LAT_SLEEPS 20
+
+//cpu time constants:
+#define CPUTIME_SLEEP 10    // ticks
+
 struct perf {
   int ctime;
   int ttime;
   int stime;
   int retime;
   int rutime;
+  int misses;
+  uint lat[LAT_BUCKETS];
+  uint maxlat;
+  int nvcsw;
+  int nivcsw;
+  unsigned long long stime_ns;
+  unsigned long long retime_ns;
+  unsigned long long rutime_ns;
 };
 
 
+struct procinfo info[NPROC];  // getprocinfo() snapshots, too big for the stack
+
 struct perf perf1;
 struct perf perf2;
 struct perf perf3;
@@ -165,6 +214,424 @@ void priority_policy_test(){
     exit(0);
 }
 
+//Every child burns CPU under policy 2, so the scheduler keeps putting processes
+//back with ever growing accumulators - monotonic keys for the priority queue.
+void pq_stress_test(){
+    int exited = 0;
+    policy(2);
+    for(int i=0; i<PQ_STRESS_CHILDS; ++i){
+        if(fork() == CHILD){
+            priority(i%10 + 1);
+            fib(24);
+            exit(i);
+        }
+    }
+
+    while(wait(null) != FAILURE)
+        ++exited;
+    policy(1);
+
+    if(exited != PQ_STRESS_CHILDS){
+        printf(2, "PQ_STRESS_TEST FAILED - only %d of %d children exited\n", exited, PQ_STRESS_CHILDS);
+        exit(-1);
+    }
+
+    printf(1,"PQ_STRESS_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//Under policy 4 the cpu shares are inversely proportional to the priority, so the
+//priority 1 hog should finish its fib before the priority 10 ones, which outnumber
+//the cpus. The sleeper is I/O-bound and must keep getting the cpu in between.
+void cfs_policy_test(){
+    int fast, sleeper, pid, first = 0;
+    policy(4);
+
+    for(int i=0; i<CFS_HOGS; ++i){
+        if(fork() == CHILD){
+            priority(10);
+            fib(32);
+            exit(0);
+        }
+    }
+
+    sleeper = fork();
+    if(sleeper == CHILD){
+        for(int i=0; i<CFS_SLEEPS; ++i)
+            sleep(1);
+        exit(0);
+    }
+
+    fast = fork();
+    if(fast == CHILD){
+        priority(1);
+        fib(32);
+        exit(0);
+    }
+
+    while((pid = wait(null)) != FAILURE)
+        if(!first && pid != sleeper)
+            first = pid;
+
+    policy(1);
+    if(first != fast){
+        printf(2, "CFS_POLICY_TEST FAILED - the priority 1 hog wasn't the first to finish\n");
+        exit(-1);
+    }
+
+    printf(1,"CFS_POLICY_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//Under policy 5 the hogs use up their time slices and sink to the low levels, while
+//the sleeper gives the cpu up before its slice is over and stays on top. It should
+//finish long before the hogs do.
+void mlfq_policy_test(){
+    int sleeper, first;
+    policy(5);
+
+    for(int i=0; i<MLFQ_HOGS; ++i){
+        if(fork() == CHILD){
+            fib(32);
+            exit(0);
+        }
+    }
+
+    sleeper = fork();
+    if(sleeper == CHILD){
+        for(int i=0; i<MLFQ_SLEEPS; ++i)
+            sleep(1);
+        exit(0);
+    }
+
+    first = wait(null);
+    while(wait(null) != FAILURE)
+        ;
+
+    policy(1);
+    if(first != sleeper){
+        printf(2, "MLFQ_POLICY_TEST FAILED - the sleeper wasn't the first to finish\n");
+        exit(-1);
+    }
+
+    printf(1,"MLFQ_POLICY_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//Under policy 6 the cpus are shared in proportion to the tickets. NCPU light and NCPU
+//heavy hogs count the work they get done in the same STRIDE_TICKS window, and the
+//heavy ones' share of the work should be STRIDE_HEAVY/(STRIDE_LIGHT+STRIDE_HEAVY).
+//There are enough hogs that none of them deserves a whole cpu.
+void stride_policy_test(){
+    int heavy[NCPU];
+    int start, end, pid, status, share, expected;
+    uint work, heavy_work = 0, total_work = 0;
+    policy(6);
+
+    start = uptime() + 10;
+    end = start + STRIDE_TICKS;
+    for(int i=0; i<2*NCPU; ++i){
+        pid = fork();
+        if(pid == CHILD){
+            tickets(i < NCPU ? STRIDE_HEAVY : STRIDE_LIGHT);
+            if(uptime() < start)
+                sleep(start - uptime());
+            for(work = 0; uptime() < end; ++work)
+                for(volatile int j=0; j<1000; ++j)
+                    ;
+            exit(work);
+        }
+        if(i < NCPU)
+            heavy[i] = pid;
+    }
+
+    while((pid = wait(&status)) != FAILURE){
+        total_work += status;
+        for(int i=0; i<NCPU; ++i)
+            if(pid == heavy[i])
+                heavy_work += status;
+    }
+
+    policy(1);
+    share = heavy_work / (total_work / 100 + 1);
+    expected = 100 * STRIDE_HEAVY / (STRIDE_LIGHT + STRIDE_HEAVY);
+    if(share < expected - STRIDE_SLACK || share > expected + STRIDE_SLACK){
+        printf(2, "STRIDE_POLICY_TEST FAILED - the heavy hogs got %d%% of the work, not %d%%\n",
+            share, expected);
+        exit(-1);
+    }
+
+    printf(1,"STRIDE_POLICY_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//A real-time process runs a short job every RT_PERIOD ticks while 2*NCPU hogs keep
+//every cpu busy. Its jobs preempt the hogs, so none of them should miss its deadline.
+void realtime_test(){
+    struct perf perf;
+    int job, pid, end, next, misses = -1;
+
+    end = uptime() + RT_JOBS * RT_PERIOD + 20;
+    for(int i=0; i<2*NCPU; ++i){
+        if(fork() == CHILD){
+            while(uptime() < end)
+                fib(20);
+            exit(0);
+        }
+    }
+
+    job = fork();
+    if(job == CHILD){
+        if(realtime(RT_PERIOD, RT_BUDGET) == FAILURE)
+            exit(-1);
+        next = uptime();
+        for(int i=0; i<RT_JOBS; ++i){
+            fib(15);
+            next += RT_PERIOD;
+            if(uptime() < next)
+                sleep(next - uptime());
+        }
+        exit(0);
+    }
+
+    while((pid = wait_stat(null, &perf)) != FAILURE)
+        if(pid == job)
+            misses = perf.misses;
+
+    if(misses != 0){
+        printf(2, "REALTIME_TEST FAILED - %d deadlines missed\n", misses);
+        exit(-1);
+    }
+
+    printf(1,"REALTIME_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//quantum() takes 0 (back to the priority's quantum) up to QUANTUM_MAX ticks. Hogs with a
+//QUANTUM_SHORT quantum run next to hogs with a QUANTUM_LONG one for QUANTUM_TICKS, and every
+//quantum that runs out is an involuntary switch, so the short ones must have more of them.
+void quantum_test(){
+    struct perf perf;
+    int shorts[NCPU];
+    int pid, end, nshort = 0, nlong = 0, is_short;
+
+    if(quantum(-1) != FAILURE || quantum(101) != FAILURE || quantum(0) == FAILURE){
+        printf(2, "QUANTUM_TEST FAILED - wrong bounds\n");
+        exit(-1);
+    }
+
+    end = uptime() + QUANTUM_TICKS;
+    for(int i=0; i<2*NCPU; ++i){
+        pid = fork();
+        if(pid == CHILD){
+            quantum(i % 2 ? QUANTUM_LONG : QUANTUM_SHORT);
+            while(uptime() < end)
+                fib(20);
+            exit(0);
+        }
+        if(i % 2 == 0)
+            shorts[i / 2] = pid;
+    }
+
+    while((pid = wait_stat(null, &perf)) != FAILURE){
+        is_short = 0;
+        for(int i=0; i<NCPU; ++i)
+            if(pid == shorts[i])
+                is_short = 1;
+        if(is_short)
+            nshort += perf.nivcsw;
+        else
+            nlong += perf.nivcsw;
+    }
+
+    if(nshort <= nlong){
+        printf(2, "QUANTUM_TEST FAILED - %d involuntary switches with quantum %d, %d with %d\n",
+            nshort, QUANTUM_SHORT, nlong, QUANTUM_LONG);
+        exit(-1);
+    }
+
+    printf(1,"QUANTUM_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//The cpu getprocinfo() says this process last ran on, which is the one it runs on now.
+int this_cpu(){
+    int n = getprocinfo(info, NPROC);
+    for(int i=0; i<n; ++i)
+        if(info[i].pid == getpid())
+            return info[i].last_cpu;
+    return FAILURE;
+}
+
+//setaffinity() rejects unknown pids and masks without a cpu. Hogs pinned to cpu 0 have
+//to run there, while the free ones may not be kept off it.
+void affinity_test(){
+    if(setaffinity(-1, 1) != FAILURE || setaffinity(getpid(), 0) != FAILURE){
+        printf(2, "AFFINITY_TEST FAILED - bad arguments accepted\n");
+        exit(-1);
+    }
+
+    for(int i=0; i<2*NCPU; ++i){
+        if(fork() == CHILD){
+            if(i % 2 && setaffinity(getpid(), 1) == FAILURE)
+                exit(1);
+            fib(25);
+            if(i % 2 && this_cpu() != 0)
+                exit(2);
+            exit(0);
+        }
+    }
+
+    int status, failed = 0;
+    while(wait(&status) != FAILURE)
+        if(status != 0)
+            failed = status;
+
+    if(failed){
+        printf(2, "AFFINITY_TEST FAILED - %s\n",
+            failed == 1 ? "a hog couldn't pin itself" : "a hog pinned to cpu 0 ran elsewhere");
+        exit(-1);
+    }
+
+    printf(1,"AFFINITY_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//Hogs forked while pinned to cpu 0 pile up on its run queue. Once they are unpinned, the
+//balancer and the idle cpus' stealing must spread them: migrations() grows, or getprocinfo()
+//shows them on more than one cpu. setaffinity() refuses a mask of offline cpus only, which
+//tells how many cpus there are; with one, there is nothing to spread to.
+void balance_test(){
+    int hogs[4*NCPU];
+    int rate, before, end, n, cpus = 0;
+    uint spread = 0;
+
+    before = migrations(&rate);
+    if(before < 0 || rate < 0){
+        printf(2, "BALANCE_TEST FAILED - negative migrations\n");
+        exit(-1);
+    }
+
+    for(int i=0; i<NCPU; ++i)
+        if(setaffinity(getpid(), 1 << i) != FAILURE)
+            cpus++;
+    if(setaffinity(getpid(), 1) == FAILURE){
+        printf(2, "BALANCE_TEST FAILED - can't pin to cpu 0\n");
+        exit(-1);
+    }
+
+    end = uptime() + BALANCE_RUN;
+    for(int i=0; i<4*NCPU; ++i){
+        hogs[i] = fork();
+        if(hogs[i] == CHILD){
+            while(uptime() < end)
+                fib(20);
+            exit(0);
+        }
+    }
+    for(int i=0; i<4*NCPU; ++i)
+        setaffinity(hogs[i], ~0);
+    setaffinity(getpid(), ~0);
+
+    sleep(BALANCE_LOOK);
+    n = getprocinfo(info, NPROC);
+    for(int i=0; i<n; ++i)
+        for(int j=0; j<4*NCPU; ++j)
+            if(info[i].pid == hogs[j] && info[i].last_cpu >= 0)
+                spread |= 1 << info[i].last_cpu;
+    while(wait(null) != FAILURE)
+        ;
+
+    if(cpus > 1 && migrations(null) == before && !(spread & (spread - 1))){
+        printf(2, "BALANCE_TEST FAILED - the hogs stayed on one of %d cpus\n", cpus);
+        exit(-1);
+    }
+
+    printf(1,"BALANCE_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//A sleeper is woken LAT_SLEEPS times, and each wakeup must land in its latency histogram
+//once it runs. Every sleep is a voluntary context switch.
+void latency_test(){
+    struct perf perf;
+    int pid, runs = 0;
+
+    pid = fork();
+    if(pid == CHILD){
+        for(int i=0; i<LAT_SLEEPS; ++i)
+            sleep(1);
+        exit(0);
+    }
+
+    if(wait_stat(null, &perf) != pid){
+        printf(2, "LATENCY_TEST FAILED - wait_stat\n");
+        exit(-1);
+    }
+
+    for(int i=0; i<LAT_BUCKETS; ++i)
+        runs += perf.lat[i];
+    if(runs < LAT_SLEEPS || perf.nvcsw < LAT_SLEEPS || perf.maxlat == 0){
+        printf(2, "LATENCY_TEST FAILED - %d wakeups, %d voluntary switches\n", runs, perf.nvcsw);
+        exit(-1);
+    }
+
+    printf(1,"LATENCY_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//A child that runs for a fraction of a tick and sleeps for CPUTIME_SLEEP ticks. Its
+//rutime in ticks may well be 0, but in ns it must not, and it must be below the sleep.
+void cputime_test(){
+    struct perf perf;
+    int pid;
+
+    pid = fork();
+    if(pid == CHILD){
+        fib(10);
+        sleep(CPUTIME_SLEEP);
+        exit(0);
+    }
+
+    if(wait_stat(null, &perf) != pid){
+        printf(2, "CPUTIME_TEST FAILED - wait_stat\n");
+        exit(-1);
+    }
+
+    if(perf.rutime_ns == 0 || perf.stime_ns <= perf.rutime_ns){
+        printf(2, "CPUTIME_TEST FAILED - ran %d ticks, slept %d ticks\n", perf.rutime, perf.stime);
+        exit(-1);
+    }
+
+    printf(1,"CPUTIME_TEST - PASSED!!!!!!!!!!!\n");
+}
+
+//getprocinfo() rejects a negative count, and its snapshot has this process running,
+//next to a sleeping child.
+void procinfo_test(){
+    int n, child, found = 0;
+
+    if(getprocinfo(info, -1) != FAILURE){
+        printf(2, "PROCINFO_TEST FAILED - a negative count accepted\n");
+        exit(-1);
+    }
+
+    child = fork();
+    if(child == CHILD){
+        sleep(100);
+        exit(0);
+    }
+    sleep(1);
+
+    n = getprocinfo(info, NPROC);
+    for(int i=0; i<n; ++i){
+        if(info[i].pid == getpid() && info[i].state == 4 /* RUNNING */)
+            found++;
+        if(info[i].pid == child && info[i].state == 2 /* SLEEPING */)
+            found++;
+    }
+    kill(child);
+    wait(null);
+
+    if(found != 2){
+        printf(2, "PROCINFO_TEST FAILED - %d processes, this one or its child missing\n", n);
+        exit(-1);
+    }
+
+    printf(1,"PROCINFO_TEST - PASSED!!!!!!!!!!!\n");
+}
+
 void performance_test(){
     int pids[] ={0,0,0,0};
     policy(1);
@@ -213,6 +680,17 @@ void performance_test(){
 
 int main (int argc, char *argv[]){
     exit_and_wait_test();
+    pq_stress_test();
+    cfs_policy_test();
+    mlfq_policy_test();
+    stride_policy_test();
+    realtime_test();
+    quantum_test();
+    affinity_test();
+    balance_test();
+    latency_test();
+    cputime_test();
+    procinfo_test();
     priority_policy_test();
     //performance_test();
     //detach_test();
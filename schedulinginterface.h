@@ -30,6 +30,15 @@ typedef struct PriorityQueue {
 	//If this queue is empty it returns null.
 	struct proc* (*extractMin)();
 
+	//Like extractMin, but the minimum is taken over the queues of all the cpus rather
+	//than the local one first. Slower, for policies that promise shares of the machine.
+	struct proc* (*extractGlobalMin)();
+
+	//Extracts the process that ran least recently, by last_tq, over the queues of all the cpus.
+	//Policy 3 (Extended priority) uses it once every 100 time quanta, against starvation.
+	//If this queue is empty it returns null.
+	struct proc* (*extractLeastRecent)();
+
 	//Call this function when you need to switch between policies.
 	//This function transfers all the mapped process to the RoundRobinQueue.
 	//It returns true if the operation succeeds. This operation may fail if you didn't
@@ -37,7 +46,6 @@ typedef struct PriorityQueue {
 	boolean (*switchToRoundRobinPolicy)();
 
 	//Extracts a specific process from the queue.
-	//Use this function in policy 3 (Extended priority) once every 100 time quanta.
 	//This function returns true if it succeeded to extract the given process,
 	//it may fail if you didn't manage the data structures correctly.
 	boolean (*extractProc)(struct proc* p);
@@ -68,6 +76,53 @@ typedef struct RoundRobinQueue {
 } RoundRobinQueue;
 
 
+//This structure holds the RUNNABLE processes - Policy 5
+typedef struct MultiLevelFeedbackQueue {
+	//Checks whether this queue is empty.
+	boolean (*isEmpty)();
+
+	//Enqueue the given process at the end of the level in its level field.
+	boolean (*enqueue)(struct proc* p);
+
+	//Removes the first process of the highest non-empty level and returns it.
+	//If the queue is empty it returns null.
+	struct proc* (*dequeue)();
+
+	//Moves every queued process to the highest level, keeping their order.
+	//Resetting the level fields of the processes is up to the caller.
+	boolean (*boost)();
+
+	//Call this function when you need to switch between policies.
+	//This function transfers all the queued processes to the RoundRobinQueue,
+	//highest level first.
+	boolean (*switchToRoundRobinPolicy)();
+
+	//Call this function when you need to switch between policies.
+	//This function transfers all the processes of the RoundRobinQueue to the
+	//highest level.
+	boolean (*switchFromRoundRobinPolicy)();
+} MultiLevelFeedbackQueue;
+
+
+//This structure holds the RUNNABLE real-time processes, above all the policies
+//A process is only taken by the cpus of its affinity mask, which must not change while it is queued.
+typedef struct RealTimeQueue {
+	//Checks whether this queue has no process the current cpu may run.
+	boolean (*isEmpty)();
+
+	//Puts the given process to the queue, keyed by its deadline field.
+	boolean (*put)(struct proc* p);
+
+	//Extract the process with the earliest deadline the current cpu may run from the queue.
+	//If there is none it returns null.
+	struct proc* (*extractMin)();
+
+	//Extracts a specific process from the queue.
+	//Returns true iff the process was in the queue.
+	boolean (*extractProc)(struct proc* p);
+} RealTimeQueue;
+
+
 //This structure holds the RUNNING processes
 typedef struct RunningProcessesHolder {
 	//Checks whether this structure is empty.
@@ -85,4 +140,8 @@ typedef struct RunningProcessesHolder {
 	//Stores the value of the minimum accumulator inside the given accumulator pointer.
 	//Returns true iff the structure isn't empty.
 	boolean (*getMinAccumulator)(long long *accumulator);
+
+	//Re-reads the accumulator of every process in the structure. The keys are taken
+	//at add(), so this must be called when a policy switch changes what they mean.
+	void (*rekey)();
 } RunningProcessesHolder;
@@ -15,6 +15,8 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->cycles = 0;
 }
 
 // Acquire the lock.
@@ -40,6 +42,9 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+#ifdef LOCKSTAT
+  lk->tsc = rdtsc();
+#endif
 }
 
 // Release the lock.
@@ -51,6 +56,10 @@ release(struct spinlock *lk)
 
   lk->pcs[0] = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->cycles += rdtsc() - lk->tsc;
+  lk->nacquire++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -96,6 +105,20 @@ holding(struct spinlock *lock)
   return r;
 }
 
+// Print how often the lock was taken and how long it was held,
+// which is only counted when built with LOCKSTAT. Cycles are printed
+// in units of 1024 to fit in cprintf's %d.
+void
+lockdump(struct spinlock *lk)
+{
+#ifdef LOCKSTAT
+  cprintf("%s: %d acquires, %d Kcycles held\n",
+          lk->name, lk->nacquire, (uint)(lk->cycles >> 10));
+#else
+  cprintf("%s: no stats, see LOCKSTAT\n", lk->name);
+#endif
+}
+
 
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
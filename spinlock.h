@@ -7,5 +7,11 @@ struct spinlock {
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For hold time statistics (see lockdump), only counted in a
+  // LOCKSTAT build, see the Makefile.
+  uint nacquire;             // Number of times the lock was acquired.
+  unsigned long long tsc;    // rdtsc() when the lock was last acquired.
+  unsigned long long cycles; // Total cycles the lock was held.
 };
 
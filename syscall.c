@@ -107,6 +107,12 @@ extern int sys_detach(void);
 extern int sys_priority(void);
 extern int sys_policy(void);
 extern int sys_wait_stat(void);
+extern int sys_tickets(void);
+extern int sys_realtime(void);
+extern int sys_quantum(void);
+extern int sys_setaffinity(void);
+extern int sys_migrations(void);
+extern int sys_getprocinfo(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +140,12 @@ static int (*syscalls[])(void) = {
 [SYS_priority] sys_priority,
 [SYS_policy]  sys_policy,
 [SYS_wait_stat]   sys_wait_stat, 
+[SYS_tickets] sys_tickets,
+[SYS_realtime] sys_realtime,
+[SYS_quantum] sys_quantum,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_migrations] sys_migrations,
+[SYS_getprocinfo] sys_getprocinfo,
 
 };
 
@@ -23,4 +23,10 @@
 #define SYS_detach   22
 #define SYS_priority 23
 #define SYS_policy	 24
-#define SYS_wait_stat	 25
\ No newline at end of file
+#define SYS_wait_stat	 25
+#define SYS_tickets	 26
+#define SYS_realtime 27
+#define SYS_quantum  28
+#define SYS_setaffinity 29
+#define SYS_migrations 30
+#define SYS_getprocinfo 31
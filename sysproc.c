@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "procinfo.h"
 
 int
 sys_fork(void)
@@ -145,10 +146,84 @@ sys_wait_stat(void)
   if(argptr(0, (void*)&status, sizeof(status)) < 0)
     return -1; 
 
-  if(argptr(0, (void*)&performance, sizeof(performance)) < 0)
+  if(argptr(1, (void*)&performance, sizeof(*performance)) < 0)
     return -1; 
 
   return wait_stat(status, performance); 
 
 
-}
\ No newline at end of file
+}
+
+int
+sys_tickets(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+
+  return tickets(n);
+}
+
+int
+sys_realtime(void)
+{
+  int period, budget;
+
+  if(argint(0, &period) < 0 || argint(1, &budget) < 0)
+    return -1;
+
+  return realtime(period, budget);
+}
+
+int
+sys_quantum(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+
+  return quantum(n);
+}
+
+int
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+
+  return setaffinity(pid, mask);
+}
+
+int
+sys_migrations(void)
+{
+  int addr;
+  int *persec = 0;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(addr && argptr(0, (void*)&persec, sizeof(*persec)) < 0)
+    return -1;
+
+  return migrations(persec);
+}
+
+int
+sys_getprocinfo(void)
+{
+  struct procinfo *info;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(argptr(0, (void*)&info, n*sizeof(*info)) < 0)
+    return -1;
+
+  return getprocinfo(info, n);
+}
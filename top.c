@@ -0,0 +1,108 @@
+// Show the processes and how they are scheduled, every few ticks.
+// Usage: top [refreshes [ticks]], refreshes 0 runs until killed.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "procinfo.h"
+
+#define TOP_REFRESHES 10
+#define TOP_TICKS 100    // a second, see lapicinit()
+
+static char *states[] = {
+  "unused", "embryo", "sleep ", "runble", "run   ", "zombie"
+};
+#define NSTATES (sizeof(states)/sizeof(states[0]))
+
+static struct procinfo info[NPROC];
+static struct procinfo last[NPROC];
+
+// printf has no %lld, and there is no 64-bit division in user
+// space, so v is divided by 10 as four 16-bit digits.
+static void
+printll(int fd, long long v)
+{
+  unsigned long long u = v < 0 ? -v : v;
+  ushort piece[4];  // u, the most significant piece first
+  char buf[21];
+  int i = sizeof(buf), j;
+  uint r;
+
+  buf[--i] = 0;
+  do {
+    piece[0] = u >> 48;
+    piece[1] = u >> 32;
+    piece[2] = u >> 16;
+    piece[3] = u;
+    for(r = 0, j = 0; j < 4; j++){  // long division
+      r = (r << 16) | piece[j];
+      piece[j] = r / 10;
+      r %= 10;
+    }
+    buf[--i] = '0' + r;
+    u = (unsigned long long)piece[0] << 48 | (unsigned long long)piece[1] << 32 |
+        (uint)piece[2] << 16 | piece[3];
+  } while(u);
+  if(v < 0)
+    buf[--i] = '-';
+  printf(fd, "%s", buf + i);
+}
+
+// The percent of the last interval p ran, from its previous snapshot.
+static int
+usage(struct procinfo *p, int nlast, int interval)
+{
+  int i;
+
+  if(interval <= 0)
+    return 0;
+  for(i = 0; i < nlast; i++)
+    if(last[i].pid == p->pid)
+      return (p->rutime - last[i].rutime) * 100 / interval;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int refreshes = TOP_REFRESHES, delay = TOP_TICKS;
+  int i, n, nlast = 0, then = 0, now;
+  struct procinfo *p;
+
+  if(argc > 1)
+    refreshes = atoi(argv[1]);
+  if(argc > 2)
+    delay = atoi(argv[2]);
+  if(argc > 3 || refreshes < 0 || delay < 1){
+    printf(2, "Usage: top [refreshes [ticks]]\n");
+    exit(-1);
+  }
+
+  for(i = 0; !refreshes || i < refreshes; i++){
+    now = uptime();
+    if((n = getprocinfo(info, NPROC)) < 0){
+      printf(2, "top: getprocinfo failed\n");
+      exit(-1);
+    }
+
+    printf(1, "\nuptime %d, %d processes\n", now, n);
+    printf(1, "pid\tstate\tcpu\tprio\t%%cpu\trun\tready\tsleep\tkey\tname\n");
+    for(p = info; p < &info[n]; p++){
+      printf(1, "%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t", p->pid,
+        p->state >= 0 && p->state < NSTATES ? states[p->state] : "???",
+        p->last_cpu, p->priority, usage(p, nlast, now - then),
+        p->rutime, p->retime, p->stime);
+      printll(1, p->accumulator);
+      printf(1, "\t%s\n", p->name);
+    }
+
+    memmove(last, info, n * sizeof(info[0]));
+    nlast = n;
+    then = now;
+    if(!refreshes || i + 1 < refreshes)
+      sleep(delay);
+  }
+
+  exit(0);
+}
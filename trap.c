@@ -43,6 +43,10 @@ trap(struct trapframe *tf)
     syscall();
     if(myproc()->killed)
       exit(0);
+    // The call may have woken a process that preempts this one, or
+    // moved this one off the cpu; don't wait for the next tick.
+    if(reschedule())
+      yield();
     return;
   }
 
@@ -51,9 +55,16 @@ trap(struct trapframe *tf)
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
+      rttick();  // before the sleepers wake, or a job due now would count as late
       wakeup(&ticks);
       release(&tickslock);
     }
+    balance();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Nothing to do: a halted scheduler just goes on, and a
+    // running process yields below if it was preempted.
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -100,11 +111,17 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit(0);
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick once its time slice
+  // (or real-time budget) is over, or when a woken process preempted it.
   // If interrupts were on while locks held, would need to check nlock.
-  if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
-    yield();
+  if(myproc() && myproc()->state == RUNNING){
+    if(tf->trapno == T_IRQ0+IRQ_TIMER && rtcharge())
+      throttle();
+    else if(tf->trapno == T_IRQ0+IRQ_TIMER && sliceover())
+      expire();
+    else if(reschedule())
+      yield();
+  }
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
@@ -1,6 +1,7 @@
 struct stat;
 struct rtcdate;
 struct perf;
+struct procinfo;
 
 // system calls
 int fork(void);
@@ -28,6 +29,12 @@ int detach(int);
 void priority (int);
 void policy (int);
 int wait_stat(int* , struct perf*);
+int tickets(int);
+int realtime(int, int);
+int quantum(int);
+int setaffinity(int, uint);
+int migrations(int*);
+int getprocinfo(struct procinfo*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);